@@ -0,0 +1,146 @@
+/**
+
+\author Michael Ferguson
+
+@b Contention microbenchmark for LatestValue and SpscRing. One writer
+replaces the value as fast as it can while N readers copy it, compared
+against the same hand-off guarded by a boost::mutex. Readers also check
+every copy for tearing.
+
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "albany_util/latest_value.h"
+#include "albany_util/spsc_ring.h"
+
+using albany_util::LatestValue;
+using albany_util::SpscRing;
+
+/* A value which is torn if a != b */
+struct Pair
+{
+  Pair () : a(0), b(0) {}
+  Pair (long x) : a(x), b(x) {}
+  long a, b;
+  double pad[14];       // roughly a tf::Transform
+};
+
+/* Same interface as LatestValue, but with a mutex */
+template<class T>
+class LockedValue
+{
+public:
+  T get () const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return value_;
+  }
+  void set (const T& value)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    value_ = value;
+  }
+private:
+  mutable boost::mutex mutex_;
+  T value_;
+};
+
+static volatile bool running;
+
+template<class Box>
+void writer (Box * box, long * writes)
+{
+  long i = 0;
+  while(running)
+    box->set(Pair(++i));
+  *writes = i;
+}
+
+template<class Box>
+void reader (Box * box, long * reads, long * torn)
+{
+  long n = 0, bad = 0;
+  while(running)
+  {
+    Pair p = box->get();
+    if(p.a != p.b)
+      bad++;
+    n++;
+  }
+  *reads = n;
+  *torn = bad;
+}
+
+template<class Box>
+void contend (const char * name, int readers, double seconds)
+{
+  Box box;
+  long writes = 0;
+  std::vector<long> reads(readers), torn(readers);
+  running = true;
+
+  boost::thread_group threads;
+  threads.create_thread(boost::bind(&writer<Box>, &box, &writes));
+  for(int i = 0; i < readers; i++)
+    threads.create_thread(boost::bind(&reader<Box>, &box, &reads[i], &torn[i]));
+  boost::this_thread::sleep(boost::posix_time::milliseconds((long)(seconds * 1000)));
+  running = false;
+  threads.join_all();
+
+  long total_reads = 0, total_torn = 0;
+  for(int i = 0; i < readers; i++)
+  {
+    total_reads += reads[i];
+    total_torn += torn[i];
+  }
+  printf("%-12s readers=%d  writes/s=%12.0f  reads/s=%12.0f  torn=%ld\n", name, readers,
+         writes / seconds, total_reads / seconds, total_torn);
+}
+
+void producer (SpscRing<long, 1024> * ring, long count)
+{
+  for(long i = 1; i <= count; i++)
+    while(!ring->push(i))
+      boost::this_thread::yield();
+}
+
+void ring_throughput (long count)
+{
+  SpscRing<long, 1024> ring;
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  boost::thread t(boost::bind(&producer, &ring, count));
+  long expected = 1, value, out_of_order = 0;
+  while(expected <= count)
+  {
+    if(!ring.pop(value))
+    {
+      boost::this_thread::yield();
+      continue;
+    }
+    if(value != expected)
+      out_of_order++;
+    expected++;
+  }
+  t.join();
+  double seconds = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+  printf("%-12s items/s=%12.0f  out_of_order=%ld\n", "spsc_ring", count / seconds, out_of_order);
+}
+
+int main (int argc, char ** argv)
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+  int counts[] = {1, 2, 4};
+  for(int i = 0; i < 3; i++)
+  {
+    contend< LatestValue<Pair> >("latest_value", counts[i], seconds);
+    contend< LockedValue<Pair> >("mutex", counts[i], seconds);
+  }
+  ring_throughput((long)(seconds * 2e7));
+  return 0;
+}
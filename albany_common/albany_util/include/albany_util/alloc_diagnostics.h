@@ -0,0 +1,75 @@
+/**
+
+\author Michael Ferguson
+
+@b Diagnostics task reporting the allocation counts of alloc_profile.h:
+
+  updater.add("Allocations", &albany_util::allocDiagnostics);
+
+For every tagged callback it gives the allocations and bytes per call
+since the previous report, the goal being zero. It warns when a tagged
+callback allocated in that period.
+
+**/
+
+#ifndef ALBANY_UTIL_ALLOC_DIAGNOSTICS_H
+#define ALBANY_UTIL_ALLOC_DIAGNOSTICS_H
+
+#include <string>
+
+#include <boost/thread.hpp>
+#include <diagnostic_updater/diagnostic_updater.h>
+
+#include "albany_util/alloc_profile.h"
+
+namespace albany_util
+{
+  inline void allocDiagnostics (diagnostic_updater::DiagnosticStatusWrapper& stat)
+  {
+    if(!alloc::installed())
+    {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Not profiled (preload libalbany_alloc_hook.so)");
+      return;
+    }
+
+    // counts at the previous report
+    static boost::mutex mutex;
+    static unsigned long last[alloc::MAX_TAGS][3];
+    boost::mutex::scoped_lock lock(mutex);
+
+    int allocating = 0;
+    for(int i = 0; i < alloc::tags(); i++)
+    {
+      const alloc::Counters& c = alloc::counters(i);
+      unsigned long calls = c.calls, allocs = c.allocs, bytes = c.alloc_bytes;
+      unsigned long d_calls = calls - last[i][0];
+      unsigned long d_allocs = allocs - last[i][1];
+      unsigned long d_bytes = bytes - last[i][2];
+      last[i][0] = calls;
+      last[i][1] = allocs;
+      last[i][2] = bytes;
+
+      std::string name(c.name);
+      if(i == 0)
+      {
+        // untagged code has no calls to divide by
+        stat.add(name + " Allocations", d_allocs);
+        stat.add(name + " Bytes", d_bytes);
+        continue;
+      }
+      if(d_allocs > 0)
+        allocating++;
+      stat.add(name + " Calls", d_calls);
+      stat.addf(name + " Allocations/Call", "%.1f", d_calls ? (double) d_allocs / d_calls : 0.0);
+      stat.addf(name + " Bytes/Call", "%.0f", d_calls ? (double) d_bytes / d_calls : 0.0);
+      stat.add(name + " Total Allocations", allocs);
+    }
+
+    if(allocating)
+      stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "%d callbacks allocating", allocating);
+    else
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No allocations in callbacks");
+  }
+}
+
+#endif
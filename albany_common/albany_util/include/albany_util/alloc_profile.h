@@ -0,0 +1,86 @@
+/**
+
+\author Michael Ferguson
+
+@b Heap allocation counts per callback, to find and keep out allocations
+in the steady state of the nodes.
+
+Mark a callback with ALBANY_ALLOC_SCOPE("name"); allocations and frees
+made on that thread until the scope ends are counted against "name",
+everything else against "other". Scopes nest, the innermost wins.
+
+Counting is opt-in at run time: it only happens when the node runs with
+the hook library preloaded, which replaces the global operator new and
+delete,
+
+  LD_PRELOAD=`rospack find albany_util`/lib/libalbany_alloc_hook.so
+
+(in a launch file: launch-prefix="env LD_PRELOAD=..."). Without it a
+scope costs two thread-local stores. Memory taken directly with malloc
+(C libraries, Eigen's aligned allocator) is not seen.
+
+The counts are reported through diagnostics, see alloc_diagnostics.h.
+
+**/
+
+#ifndef ALBANY_UTIL_ALLOC_PROFILE_H
+#define ALBANY_UTIL_ALLOC_PROFILE_H
+
+#include <stddef.h>
+
+namespace albany_util
+{
+  namespace alloc
+  {
+    static const int MAX_TAGS = 32;
+
+    struct Counters
+    {
+      const char * name;
+      volatile unsigned long calls;
+      volatile unsigned long allocs;
+      volatile unsigned long alloc_bytes;
+      volatile unsigned long frees;
+      volatile unsigned long free_bytes;
+    };
+
+    /* Index of the counters for name, registered on first use */
+    int tag (const char * name);
+
+    /* Make tag current on this thread, returns the tag it replaces */
+    int enter (int tag);
+    void leave (int previous);
+
+    /* Called by the hook library */
+    void install ();
+    void recordAlloc (size_t bytes);
+    void recordFree (size_t bytes);
+
+    /* True when the hook library is loaded */
+    bool installed ();
+
+    /* Registered tags, 0 is "other" */
+    int tags ();
+    const Counters& counters (int tag);
+  }
+
+  class AllocScope
+  {
+  public:
+    explicit AllocScope (int tag) : previous_(alloc::enter(tag)) {}
+    ~AllocScope ()
+    {
+      alloc::leave(previous_);
+    }
+  private:
+    int previous_;
+  };
+}
+
+#define ALBANY_ALLOC_CAT2(a, b) a ## b
+#define ALBANY_ALLOC_CAT(a, b) ALBANY_ALLOC_CAT2(a, b)
+#define ALBANY_ALLOC_SCOPE(name) \
+  static int ALBANY_ALLOC_CAT(alloc_tag_, __LINE__) = albany_util::alloc::tag(name); \
+  albany_util::AllocScope ALBANY_ALLOC_CAT(alloc_scope_, __LINE__)(ALBANY_ALLOC_CAT(alloc_tag_, __LINE__))
+
+#endif
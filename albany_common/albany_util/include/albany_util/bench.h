@@ -0,0 +1,113 @@
+/**
+
+\author Michael Ferguson
+
+@b Minimal microbenchmark harness shared by the package "bench" targets.
+
+Each benchmark is a function run repeatedly for at least a minimum time,
+the time of every call is kept and the report gives the median, mean
+and minimum. Results are written as JSON which
+albany_util/scripts/bench_compare.py checks against a stored baseline:
+
+  {"package": "coreslam", "benchmarks": [
+    {"name": "update_map_conversion", "iterations": 120,
+     "median_ns": 8100000, "mean_ns": 8300000, "min_ns": 7900000}, ...]}
+
+**/
+
+#ifndef ALBANY_UTIL_BENCH_H
+#define ALBANY_UTIL_BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/function.hpp>
+
+namespace albany_util
+{
+  class BenchReport
+  {
+  public:
+    /* Output goes to argv[1] if given, otherwise stdout */
+    BenchReport (const std::string& package, int argc, char ** argv, double min_seconds = 1.0) :
+      package_(package), min_seconds_(min_seconds)
+    {
+      if(argc > 1)
+        filename_ = argv[1];
+    }
+
+    /* Run fn until min_seconds and at least 5 calls have passed */
+    void run (const std::string& name, const boost::function<void ()>& fn)
+    {
+      fn();     // warm caches and lazy allocations
+
+      std::vector<double> times;
+      double total = 0;
+      while(total < min_seconds_ * 1e9 || times.size() < 5)
+      {
+        double start = now();
+        fn();
+        double t = now() - start;
+        times.push_back(t);
+        total += t;
+      }
+      std::sort(times.begin(), times.end());
+
+      Result r;
+      r.name = name;
+      r.iterations = times.size();
+      r.median = times[times.size()/2];
+      r.mean = total / times.size();
+      r.min = times[0];
+      results_.push_back(r);
+      fprintf(stderr, "%-32s %8d runs  median %12.0f ns  min %12.0f ns\n",
+              name.c_str(), r.iterations, r.median, r.min);
+    }
+
+    bool write ()
+    {
+      FILE * f = filename_.empty() ? stdout : fopen(filename_.c_str(), "w");
+      if(!f)
+      {
+        fprintf(stderr, "Could not write %s\n", filename_.c_str());
+        return false;
+      }
+      fprintf(f, "{\"package\": \"%s\", \"benchmarks\": [", package_.c_str());
+      for(size_t i = 0; i < results_.size(); i++)
+      {
+        const Result& r = results_[i];
+        fprintf(f, "%s\n  {\"name\": \"%s\", \"iterations\": %d, \"median_ns\": %.0f, \"mean_ns\": %.0f, \"min_ns\": %.0f}",
+                i ? "," : "", r.name.c_str(), r.iterations, r.median, r.mean, r.min);
+      }
+      fprintf(f, "\n]}\n");
+      if(f != stdout)
+        fclose(f);
+      return true;
+    }
+
+  private:
+    struct Result
+    {
+      std::string name;
+      int iterations;
+      double median, mean, min;
+    };
+
+    static double now ()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1e9 + ts.tv_nsec;
+    }
+
+    std::string package_;
+    std::string filename_;
+    double min_seconds_;
+    std::vector<Result> results_;
+  };
+}
+
+#endif
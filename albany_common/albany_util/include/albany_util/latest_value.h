@@ -0,0 +1,140 @@
+/**
+
+\author Michael Ferguson
+
+@b The latest value of something shared between threads, such as the
+newest message from a callback or a transform computed in one thread
+and broadcast from another.
+
+This is a left-right construction: two copies of the value are kept,
+readers always copy the one the writer is not touching, and the writer
+updates the other copy only once every reader of it has left. Reads
+never wait and never retry, writes may briefly spin while a reader
+finishes its copy. Writers are serialized among themselves.
+
+T must be default constructible and assignable, copying a T is the
+whole of a read, so keep T small (a shared_ptr to a message, a
+transform).
+
+**/
+
+#ifndef ALBANY_UTIL_LATEST_VALUE_H
+#define ALBANY_UTIL_LATEST_VALUE_H
+
+#include <sched.h>
+
+namespace albany_util
+{
+  template<class T>
+  class LatestValue
+  {
+  public:
+    LatestValue () : left_right_(0), version_index_(0), version_(0), writing_(0)
+    {
+      readers_[0] = readers_[1] = 0;
+      versions_[0] = versions_[1] = 0;
+    }
+
+    explicit LatestValue (const T& value) : left_right_(0), version_index_(0), version_(0), writing_(0)
+    {
+      readers_[0] = readers_[1] = 0;
+      versions_[0] = versions_[1] = 0;
+      values_[0] = values_[1] = value;
+    }
+
+    /* Copies take a snapshot of the current value */
+    LatestValue (const LatestValue& other) : left_right_(0), version_index_(0), writing_(0)
+    {
+      unsigned long version;
+      readers_[0] = readers_[1] = 0;
+      values_[0] = values_[1] = other.get(&version);
+      versions_[0] = versions_[1] = version_ = version;
+    }
+
+    /* Assignment sets a snapshot of the other value, so these can live in containers */
+    LatestValue& operator= (const LatestValue& other)
+    {
+      if(this != &other)
+        set(other.get());
+      return *this;
+    }
+
+    /*
+     * Copy of the latest value. Wait-free. If version is given it is set
+     * to the version of the returned value, 0 if nothing was ever set.
+     */
+    T get (unsigned long * version = 0) const
+    {
+      int vi = version_index_;
+      __sync_fetch_and_add(&readers_[vi], 1);   // full barrier
+      int lr = left_right_;
+      T value = values_[lr];
+      if(version)
+        *version = versions_[lr];
+      __sync_fetch_and_sub(&readers_[vi], 1);
+      return value;
+    }
+
+    /*
+     * Version of the latest value, bumped by every set(). Lets a reader
+     * check for news without copying the value.
+     */
+    unsigned long version () const
+    {
+      __sync_synchronize();
+      return version_;
+    }
+
+    /* Replace the value, returns its version */
+    unsigned long set (const T& value)
+    {
+      while(__sync_lock_test_and_set(&writing_, 1))
+        sched_yield();
+
+      unsigned long version = version_ + 1;
+      int lr = left_right_;
+      values_[1-lr] = value;
+      versions_[1-lr] = version;
+      __sync_synchronize();
+      left_right_ = 1-lr;       // new readers now copy the new value
+      version_ = version;
+      __sync_synchronize();
+
+      // wait out readers that may still be copying the old value
+      int vi = version_index_;
+      waitForReaders(1-vi);
+      version_index_ = 1-vi;
+      __sync_synchronize();
+      waitForReaders(vi);
+
+      values_[lr] = value;
+      versions_[lr] = version;
+
+      __sync_lock_release(&writing_);
+      return version;
+    }
+
+    /* Drop the held value, e.g. to release a large message */
+    void reset ()
+    {
+      set(T());
+    }
+
+  private:
+    void waitForReaders (int vi)
+    {
+      while(readers_[vi] != 0)
+        sched_yield();
+    }
+
+    T values_[2];
+    unsigned long versions_[2];
+    volatile int left_right_;
+    volatile int version_index_;
+    mutable volatile long readers_[2];
+    volatile unsigned long version_;
+    volatile int writing_;
+  };
+}
+
+#endif
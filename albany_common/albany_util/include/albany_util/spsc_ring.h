@@ -0,0 +1,72 @@
+/**
+
+\author Michael Ferguson
+
+@b Bounded queue between exactly one producer thread and exactly one
+consumer thread. Neither side ever waits: push() fails when the ring is
+full, pop() fails when it is empty. Size must be a power of two, the
+ring holds up to Size-1 items.
+
+**/
+
+#ifndef ALBANY_UTIL_SPSC_RING_H
+#define ALBANY_UTIL_SPSC_RING_H
+
+namespace albany_util
+{
+  template<class T, unsigned int Size>
+  class SpscRing
+  {
+  public:
+    SpscRing () : head_(0), tail_(0) {}
+
+    /* Producer side. Returns false if the ring is full. */
+    bool push (const T& value)
+    {
+      unsigned int head = head_;
+      unsigned int next = (head + 1) & (Size - 1);
+      if(next == tail_)
+        return false;
+      items_[head] = value;
+      __sync_synchronize();     // item is written before it is visible
+      head_ = next;
+      return true;
+    }
+
+    /* Consumer side. Returns false if the ring is empty. */
+    bool pop (T& value)
+    {
+      unsigned int tail = tail_;
+      if(tail == head_)
+        return false;
+      __sync_synchronize();     // item is read after it is visible
+      value = items_[tail];
+      items_[tail] = T();       // don't keep large items alive
+      __sync_synchronize();
+      tail_ = (tail + 1) & (Size - 1);
+      return true;
+    }
+
+    /* Approximate when called from neither side */
+    unsigned int size () const
+    {
+      return (head_ - tail_) & (Size - 1);
+    }
+
+    bool empty () const
+    {
+      return head_ == tail_;
+    }
+
+  private:
+    // Size must be a power of two
+    typedef char size_is_power_of_two[(Size & (Size - 1)) == 0 ? 1 : -1];
+
+    T items_[Size];
+    volatile unsigned int head_;    // written by producer
+    char pad_[64];                  // keep the two indices on separate cache lines
+    volatile unsigned int tail_;    // written by consumer
+  };
+}
+
+#endif
@@ -0,0 +1,110 @@
+/**
+
+\author Michael Ferguson
+
+@b Work-stealing thread pool shared by the albany nodes, so that nodes
+co-located on one board split the cores between them instead of each
+spawning its own threads.
+
+Every worker owns a deque of tasks per priority. A worker pops its own
+newest task first (the data it touched last is still in cache) and
+otherwise steals the oldest task of another worker, always taking the
+highest priority it can find. Tasks posted from outside the pool are
+spread round-robin across the workers.
+
+The pool is sized and placed by ROS parameters, see ThreadPool(nh):
+
+ - threads : number of workers (default: one per cpu listed, else one
+   per core)
+ - cpus    : list of cores the workers are pinned to, e.g. [2, 3]; give
+   each co-located node its own cores
+ - nice    : nice value for the workers, so a node can yield to another
+
+**/
+
+#ifndef ALBANY_UTIL_THREAD_POOL_H
+#define ALBANY_UTIL_THREAD_POOL_H
+
+#include <deque>
+#include <vector>
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace albany_util
+{
+  class ThreadPool
+  {
+  public:
+    enum Priority
+    {
+      LOW = 0,
+      NORMAL = 1,
+      HIGH = 2
+    };
+    static const int PRIORITIES = 3;
+
+    typedef boost::function<void ()> Task;
+    typedef boost::function<void (int, int)> RangeTask;
+
+    /* threads <= 0 means one per core, cpus empty means no pinning */
+    explicit ThreadPool (int threads, const std::vector<int>& cpus = std::vector<int>(), int nice = 0);
+
+    /* Read threads/cpus/nice from parameters under nh, e.g. "~pool" */
+    explicit ThreadPool (const ros::NodeHandle& nh, int default_threads = 0);
+
+    /* Runs the tasks still queued, then joins the workers */
+    ~ThreadPool ();
+
+    void post (const Task& task, Priority priority = NORMAL);
+
+    /*
+     * Call body(b, e) over [begin, end) split into chunks of grain items
+     * (0 picks a grain giving each worker a few chunks), and return once
+     * all chunks are done. The calling thread works on chunks too, so
+     * this may be called from inside a task without deadlocking.
+     */
+    void parallelFor (int begin, int end, const RangeTask& body, int grain = 0);
+
+    int size () const
+    {
+      return workers_.size();
+    }
+
+    /* Tasks posted but not yet started */
+    long queued () const
+    {
+      return queued_;
+    }
+
+  private:
+    struct Worker
+    {
+      boost::mutex mutex;
+      std::deque<Task> tasks[PRIORITIES];
+      boost::thread thread;
+    };
+
+    void start (int threads);
+    void run (int index);
+    bool pop (int index, Task& task);
+    static bool take (Worker& worker, int priority, bool newest, Task& task);
+
+    std::vector<boost::shared_ptr<Worker> > workers_;
+    std::vector<int> cpus_;
+    int nice_;
+
+    volatile long queued_;
+    volatile unsigned long next_;   // round robin for outside posts
+    boost::mutex idle_mutex_;
+    boost::condition_variable idle_cond_;
+    bool shutdown_;                 // guarded by idle_mutex_
+
+    ThreadPool (const ThreadPool&);
+    ThreadPool& operator= (const ThreadPool&);
+  };
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+
+\author Michael Ferguson
+
+@b Timeline tracing for the albany nodes, exported as Chrome trace JSON
+(chrome://tracing, ui.perfetto.dev).
+
+Mark a scope with ALBANY_TRACE("name"); when tracing is enabled its
+start and duration are recorded into a buffer owned by the current
+thread. Recording takes no lock and allocates nothing, a thread
+overwrites its oldest spans once its buffer is full. When tracing is
+disabled a span costs one branch.
+
+A node enables tracing by constructing a TraceDumper, which reads its
+parameters (under ~trace):
+
+ - enabled : record spans (default false)
+ - events  : spans kept per thread (default 16384)
+ - file    : where dumps are written (default /tmp/<node>_trace.json)
+
+and writes the buffers out when the ~trace/dump service (std_srvs/Empty)
+is called or the node receives SIGUSR2. Timestamps come from the
+monotonic clock, so dumps of several nodes on one host line up; merge
+them with albany_util/scripts/merge_traces.py.
+
+**/
+
+#ifndef ALBANY_UTIL_TRACE_H
+#define ALBANY_UTIL_TRACE_H
+
+#include <string>
+
+#include <ros/ros.h>
+#include <std_srvs/Empty.h>
+
+namespace albany_util
+{
+  namespace trace
+  {
+    extern volatile bool enabled;
+
+    /* Microseconds on the monotonic clock */
+    unsigned long long now ();
+
+    /* Record a finished span on the calling thread's buffer */
+    void record (const char * name, unsigned long long start, unsigned long long end);
+
+    /* Write every thread's buffer as Chrome trace JSON */
+    bool dump (const std::string& filename, const std::string& process_name);
+  }
+
+  /* Records its own lifetime, name must outlive the program (a literal) */
+  class TraceSpan
+  {
+  public:
+    explicit TraceSpan (const char * name) : name_(name), start_(trace::enabled ? trace::now() : 0) {}
+    ~TraceSpan ()
+    {
+      if(start_)
+        trace::record(name_, start_, trace::now());
+    }
+  private:
+    const char * name_;
+    unsigned long long start_;
+  };
+
+  class TraceDumper
+  {
+  public:
+    explicit TraceDumper (const ros::NodeHandle& nh = ros::NodeHandle("~trace"));
+
+    bool dump ();
+
+  private:
+    bool dumpCallback (std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
+    void signalCallback (const ros::WallTimerEvent& e);
+
+    std::string filename_;
+    ros::ServiceServer service_;
+    ros::WallTimer signal_timer_;
+  };
+}
+
+#define ALBANY_TRACE_CAT2(a, b) a ## b
+#define ALBANY_TRACE_CAT(a, b) ALBANY_TRACE_CAT2(a, b)
+#define ALBANY_TRACE(name) albany_util::TraceSpan ALBANY_TRACE_CAT(trace_span_, __LINE__)(name)
+
+#endif
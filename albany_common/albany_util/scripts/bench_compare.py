@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+
+"""
+  Compare benchmark results (see albany_util/bench.h) against a stored
+  baseline and flag regressions. Medians are compared; a benchmark is
+  a regression when it is slower than the baseline by more than the
+  threshold. If there is no baseline yet, the results become it.
+
+  usage: bench_compare.py [--threshold 0.10] [--update] baseline.json results.json
+
+  Exits 1 if anything regressed, so it can gate a "make bench".
+"""
+
+import sys
+import json
+import shutil
+import os.path
+from optparse import OptionParser
+
+def load(filename):
+    with open(filename) as f:
+        data = json.load(f)
+    return data["package"], dict((b["name"], b) for b in data["benchmarks"])
+
+if __name__ == "__main__":
+    parser = OptionParser(usage="%prog [options] baseline.json results.json")
+    parser.add_option("-t", "--threshold", type="float", default=0.10,
+                      help="allowed slowdown as a fraction of the baseline median (default 0.10)")
+    parser.add_option("-u", "--update", action="store_true", default=False,
+                      help="store the results as the new baseline")
+    (options, args) = parser.parse_args()
+    if len(args) != 2:
+        parser.error("need a baseline and a results file")
+    baseline_file, results_file = args
+
+    if not os.path.exists(baseline_file) or options.update:
+        shutil.copyfile(results_file, baseline_file)
+        print "stored %s as baseline %s" % (results_file, baseline_file)
+        sys.exit(0)
+
+    package, baseline = load(baseline_file)
+    package, results = load(results_file)
+
+    regressions = 0
+    print "%-32s %14s %14s %8s" % (package, "baseline (ns)", "now (ns)", "change")
+    for name in sorted(results.keys()):
+        now = results[name]["median_ns"]
+        if name not in baseline:
+            print "%-32s %14s %14.0f %8s" % (name, "-", now, "new")
+            continue
+        base = baseline[name]["median_ns"]
+        change = float(now - base) / base if base > 0 else 0.0
+        flag = ""
+        if change > options.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print "%-32s %14.0f %14.0f %+7.1f%%%s" % (name, base, now, change * 100, flag)
+    for name in sorted(set(baseline.keys()) - set(results.keys())):
+        print "%-32s %14.0f %14s %8s" % (name, baseline[name]["median_ns"], "-", "gone")
+
+    if regressions:
+        print "%d benchmark(s) regressed by more than %.0f%%" % (regressions, options.threshold * 100)
+        sys.exit(1)
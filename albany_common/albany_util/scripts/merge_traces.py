@@ -0,0 +1,24 @@
+#!/usr/bin/env python
+
+"""
+  Merge the Chrome trace dumps of several nodes (see albany_util/trace.h)
+  into one file, so a single timeline shows all of them. The nodes must
+  have run on the same host, their timestamps share the monotonic clock.
+
+  usage: merge_traces.py out.json in1.json in2.json ...
+"""
+
+import sys
+import json
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print "usage: merge_traces.py out.json in1.json in2.json ..."
+        sys.exit(1)
+    events = list()
+    for name in sys.argv[2:]:
+        with open(name) as f:
+            events += json.load(f)["traceEvents"]
+    with open(sys.argv[1], "w") as f:
+        json.dump({"traceEvents": events}, f)
+    print "merged %d events from %d files" % (len(events), len(sys.argv)-2)
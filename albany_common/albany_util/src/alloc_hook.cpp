@@ -0,0 +1,91 @@
+/**
+
+\author Michael Ferguson
+
+@b Replacement global operator new/delete which count into
+albany_util::alloc. Built as libalbany_alloc_hook.so and only ever
+LD_PRELOADed, never linked, see alloc_profile.h.
+
+**/
+
+#include "albany_util/alloc_profile.h"
+
+#include <new>
+#include <stdlib.h>
+#include <malloc.h>
+
+namespace
+{
+  struct Install
+  {
+    Install ()
+    {
+      albany_util::alloc::install();
+    }
+  } install;
+
+  /* Both sides count the usable size, so the bytes freed balance the
+     bytes allocated */
+  inline void * allocate (size_t size)
+  {
+    void * p = malloc(size ? size : 1);
+    if(p)
+      albany_util::alloc::recordAlloc(malloc_usable_size(p));
+    return p;
+  }
+
+  inline void release (void * p)
+  {
+    if(p)
+    {
+      albany_util::alloc::recordFree(malloc_usable_size(p));
+      free(p);
+    }
+  }
+}
+
+void * operator new (size_t size) throw(std::bad_alloc)
+{
+  void * p = allocate(size);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new[] (size_t size) throw(std::bad_alloc)
+{
+  void * p = allocate(size);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void * operator new (size_t size, const std::nothrow_t&) throw()
+{
+  return allocate(size);
+}
+
+void * operator new[] (size_t size, const std::nothrow_t&) throw()
+{
+  return allocate(size);
+}
+
+void operator delete (void * p) throw()
+{
+  release(p);
+}
+
+void operator delete[] (void * p) throw()
+{
+  release(p);
+}
+
+void operator delete (void * p, const std::nothrow_t&) throw()
+{
+  release(p);
+}
+
+void operator delete[] (void * p, const std::nothrow_t&) throw()
+{
+  release(p);
+}
@@ -0,0 +1,99 @@
+/**
+
+\author Michael Ferguson
+
+@b Allocation counting, see alloc_profile.h. Nothing here may allocate,
+it runs inside operator new. All state is constant-initialized, so the
+hook can count allocations made before static constructors run.
+
+**/
+
+#include "albany_util/alloc_profile.h"
+
+#include <string.h>
+#include <sched.h>
+
+namespace albany_util
+{
+  namespace alloc
+  {
+    static Counters counters_[MAX_TAGS] = { { "other", 0, 0, 0, 0, 0 } };
+    static volatile int tags_ = 1;
+    static volatile int registering_ = 0;
+    static volatile bool installed_ = false;
+    static __thread int current_ = 0;
+
+    int tag (const char * name)
+    {
+      while(__sync_lock_test_and_set(&registering_, 1))
+        sched_yield();
+      int index = 0;
+      for(int i = 1; i < tags_; i++)
+      {
+        if(strcmp(counters_[i].name, name) == 0)
+        {
+          index = i;
+          break;
+        }
+      }
+      if(index == 0 && tags_ < MAX_TAGS)
+      {
+        // out of tags counts as "other"
+        index = tags_;
+        counters_[index].name = name;
+        __sync_synchronize();
+        tags_ = index + 1;
+      }
+      __sync_lock_release(&registering_);
+      return index;
+    }
+
+    int enter (int tag)
+    {
+      int previous = current_;
+      current_ = tag;
+      if(installed_)
+        __sync_fetch_and_add(&counters_[tag].calls, 1);
+      return previous;
+    }
+
+    void leave (int previous)
+    {
+      current_ = previous;
+    }
+
+    void install ()
+    {
+      installed_ = true;
+    }
+
+    bool installed ()
+    {
+      return installed_;
+    }
+
+    void recordAlloc (size_t bytes)
+    {
+      Counters& c = counters_[current_];
+      __sync_fetch_and_add(&c.allocs, 1);
+      __sync_fetch_and_add(&c.alloc_bytes, bytes);
+    }
+
+    void recordFree (size_t bytes)
+    {
+      Counters& c = counters_[current_];
+      __sync_fetch_and_add(&c.frees, 1);
+      __sync_fetch_and_add(&c.free_bytes, bytes);
+    }
+
+    int tags ()
+    {
+      return tags_;
+    }
+
+    const Counters& counters (int tag)
+    {
+      return counters_[tag];
+    }
+  }
+}
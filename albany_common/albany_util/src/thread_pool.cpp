@@ -0,0 +1,235 @@
+/**
+
+\author Michael Ferguson
+
+@b Work-stealing thread pool, see thread_pool.h.
+
+**/
+
+#include "albany_util/thread_pool.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+namespace albany_util
+{
+  // pool and index of the worker running on this thread, if any
+  static __thread ThreadPool * current_pool = NULL;
+  static __thread int current_index = -1;
+
+  ThreadPool::ThreadPool (int threads, const std::vector<int>& cpus, int nice) :
+    cpus_(cpus), nice_(nice), queued_(0), next_(0), shutdown_(false)
+  {
+    start(threads);
+  }
+
+  ThreadPool::ThreadPool (const ros::NodeHandle& nh, int default_threads) :
+    nice_(0), queued_(0), next_(0), shutdown_(false)
+  {
+    XmlRpc::XmlRpcValue cpus;
+    if(nh.getParam("cpus", cpus))
+    {
+      if(cpus.getType() == XmlRpc::XmlRpcValue::TypeArray)
+      {
+        for(int i = 0; i < cpus.size(); i++)
+          if(cpus[i].getType() == XmlRpc::XmlRpcValue::TypeInt)
+            cpus_.push_back(static_cast<int>(cpus[i]));
+      }
+      else
+        ROS_WARN("%s/cpus should be a list of cores", nh.getNamespace().c_str());
+    }
+
+    int threads;
+    nh.param("threads", threads, default_threads > 0 ? default_threads : (int) cpus_.size());
+    nh.param("nice", nice_, 0);
+    start(threads);
+  }
+
+  ThreadPool::~ThreadPool ()
+  {
+    {
+      boost::mutex::scoped_lock lock(idle_mutex_);
+      shutdown_ = true;
+    }
+    idle_cond_.notify_all();
+    for(size_t i = 0; i < workers_.size(); i++)
+      workers_[i]->thread.join();
+  }
+
+  void ThreadPool::start (int threads)
+  {
+    if(threads <= 0)
+      threads = std::max(1u, boost::thread::hardware_concurrency());
+    for(int i = 0; i < threads; i++)
+      workers_.push_back(boost::shared_ptr<Worker>(new Worker()));
+    for(int i = 0; i < threads; i++)
+      workers_[i]->thread = boost::thread(boost::bind(&ThreadPool::run, this, i));
+    ROS_DEBUG("Thread pool of %d workers on %d pinned cores", threads, (int) cpus_.size());
+  }
+
+  void ThreadPool::post (const Task& task, Priority priority)
+  {
+    int index;
+    if(current_pool == this)
+      index = current_index;    // keep it local, it is likely to share our data
+    else
+      index = __sync_fetch_and_add(&next_, 1) % workers_.size();
+
+    {
+      Worker& worker = *workers_[index];
+      boost::mutex::scoped_lock lock(worker.mutex);
+      worker.tasks[priority].push_back(task);
+    }
+    __sync_fetch_and_add(&queued_, 1);
+
+    // a worker checks queued_ under idle_mutex_ before it sleeps
+    boost::mutex::scoped_lock lock(idle_mutex_);
+    idle_cond_.notify_one();
+  }
+
+  bool ThreadPool::take (Worker& worker, int priority, bool newest, Task& task)
+  {
+    boost::mutex::scoped_lock lock(worker.mutex);
+    std::deque<Task>& tasks = worker.tasks[priority];
+    if(tasks.empty())
+      return false;
+    if(newest)
+    {
+      task.swap(tasks.back());
+      tasks.pop_back();
+    }
+    else
+    {
+      task.swap(tasks.front());
+      tasks.pop_front();
+    }
+    return true;
+  }
+
+  bool ThreadPool::pop (int index, Task& task)
+  {
+    int n = workers_.size();
+    for(int p = PRIORITIES-1; p >= 0; p--)
+    {
+      if(take(*workers_[index], p, true, task))
+        return true;
+      for(int i = 1; i < n; i++)
+        if(take(*workers_[(index+i) % n], p, false, task))
+          return true;
+    }
+    return false;
+  }
+
+  void ThreadPool::run (int index)
+  {
+    current_pool = this;
+    current_index = index;
+
+    if(!cpus_.empty())
+    {
+      // each worker gets one of the listed cores
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus_[index % cpus_.size()], &set);
+      if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        ROS_WARN("Could not pin pool worker %d to cpu %d", index, cpus_[index % cpus_.size()]);
+    }
+    if(nice_ != 0)
+    {
+      // on Linux the nice value is per thread
+      if(setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice_) != 0)
+        ROS_WARN("Could not set nice value %d for pool worker %d", nice_, index);
+    }
+
+    while(true)
+    {
+      Task task;
+      if(pop(index, task))
+      {
+        __sync_fetch_and_sub(&queued_, 1);
+        try
+        {
+          task();
+        }
+        catch(std::exception& e)
+        {
+          ROS_ERROR("Pool task threw: %s", e.what());
+        }
+        continue;
+      }
+
+      boost::mutex::scoped_lock lock(idle_mutex_);
+      while(queued_ == 0 && !shutdown_)
+        idle_cond_.wait(lock);
+      if(queued_ == 0 && shutdown_)
+        return;
+    }
+  }
+
+  /*
+   * Shared between the caller of parallelFor and its helpers, helpers
+   * which only start after the loop is over still find it alive.
+   */
+  struct ForState
+  {
+    ThreadPool::RangeTask body;
+    int begin, end, grain;
+    long chunks;
+    volatile long next;
+    volatile long done;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+  };
+
+  static void runChunks (boost::shared_ptr<ForState> s)
+  {
+    long c;
+    while((c = __sync_fetch_and_add(&s->next, 1)) < s->chunks)
+    {
+      int b = s->begin + c * s->grain;
+      s->body(b, std::min(b + s->grain, s->end));
+      if(__sync_add_and_fetch(&s->done, 1) == s->chunks)
+      {
+        boost::mutex::scoped_lock lock(s->mutex);
+        s->cond.notify_all();
+      }
+    }
+  }
+
+  void ThreadPool::parallelFor (int begin, int end, const RangeTask& body, int grain)
+  {
+    int n = end - begin;
+    if(n <= 0)
+      return;
+    if(grain <= 0)
+      grain = std::max(1, n / (4 * size()));
+
+    boost::shared_ptr<ForState> s(new ForState());
+    s->body = body;
+    s->begin = begin;
+    s->end = end;
+    s->grain = grain;
+    s->chunks = (n + grain - 1) / grain;
+    s->next = 0;
+    s->done = 0;
+    if(s->chunks == 1)
+    {
+      body(begin, end);
+      return;
+    }
+
+    int helpers = std::min((long) size(), s->chunks - 1);
+    for(int i = 0; i < helpers; i++)
+      post(boost::bind(&runChunks, s), HIGH);
+    runChunks(s);
+
+    boost::mutex::scoped_lock lock(s->mutex);
+    while(s->done < s->chunks)
+      s->cond.wait(lock);
+  }
+}
@@ -0,0 +1,204 @@
+/**
+
+\author Michael Ferguson
+
+@b Timeline tracing, see trace.h.
+
+**/
+
+#include "albany_util/trace.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace albany_util
+{
+  namespace trace
+  {
+    volatile bool enabled = false;
+
+    struct Event
+    {
+      const char * name;
+      unsigned long long start;
+      unsigned long long end;
+    };
+
+    /*
+     * Spans of one thread. Only the owning thread writes, it bumps
+     * written after each event, so a dump can tell which events it
+     * copied may have been overwritten meanwhile.
+     */
+    struct Buffer
+    {
+      long tid;
+      std::vector<Event> events;
+      volatile unsigned long written;
+    };
+
+    static unsigned long capacity = 16384;
+    static boost::mutex buffers_mutex;
+    static std::vector<Buffer*> buffers;     // never freed, one per thread that traced
+    static __thread Buffer * buffer = NULL;
+
+    unsigned long long now ()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    void record (const char * name, unsigned long long start, unsigned long long end)
+    {
+      if(!buffer)
+      {
+        Buffer * b = new Buffer();
+        b->tid = syscall(SYS_gettid);
+        b->events.resize(capacity);
+        b->written = 0;
+        boost::mutex::scoped_lock lock(buffers_mutex);
+        buffers.push_back(b);
+        buffer = b;
+      }
+      Event& e = buffer->events[buffer->written % buffer->events.size()];
+      e.name = name;
+      e.start = start;
+      e.end = end;
+      __sync_synchronize();
+      buffer->written++;
+    }
+
+    /* Names are literals from our own code, but keep the JSON valid anyway */
+    static void writeString (FILE * f, const char * s)
+    {
+      fputc('"', f);
+      for(; *s; s++)
+      {
+        if(*s == '"' || *s == '\\')
+          fputc('\\', f);
+        if((unsigned char) *s >= 0x20)
+          fputc(*s, f);
+      }
+      fputc('"', f);
+    }
+
+    bool dump (const std::string& filename, const std::string& process_name)
+    {
+      std::vector<Buffer*> snapshot;
+      {
+        boost::mutex::scoped_lock lock(buffers_mutex);
+        snapshot = buffers;
+      }
+
+      FILE * f = fopen(filename.c_str(), "w");
+      if(!f)
+        return false;
+      long pid = getpid();
+      fprintf(f, "{\"traceEvents\":[\n");
+      fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":0,\"args\":{\"name\":", pid);
+      writeString(f, process_name.c_str());
+      fprintf(f, "}}");
+
+      size_t spans = 0;
+      std::vector<Event> copy;
+      for(size_t i = 0; i < snapshot.size(); i++)
+      {
+        Buffer& b = *snapshot[i];
+        unsigned long size = b.events.size();
+        unsigned long last = b.written;
+        __sync_synchronize();
+        unsigned long first = last > size ? last - size : 0;
+        copy.resize(last - first);
+        for(unsigned long n = first; n < last; n++)
+          copy[n - first] = b.events[n % size];
+        __sync_synchronize();
+
+        // anything the thread wrapped over while we copied is suspect
+        unsigned long after = b.written;
+        unsigned long valid = after > size ? after - size : 0;
+        for(unsigned long n = std::max(first, valid); n < last; n++)
+        {
+          const Event& e = copy[n - first];
+          fprintf(f, ",\n{\"name\":");
+          writeString(f, e.name);
+          fprintf(f, ",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%llu,\"dur\":%llu}",
+                  pid, b.tid, e.start, e.end - e.start);
+          spans++;
+        }
+      }
+      fprintf(f, "\n]}\n");
+      bool ok = !ferror(f);
+      fclose(f);
+      ROS_INFO("Wrote %u spans from %u threads to %s", (unsigned) spans, (unsigned) snapshot.size(), filename.c_str());
+      return ok;
+    }
+
+    static volatile sig_atomic_t dump_requested = 0;
+
+    static void onSignal (int)
+    {
+      dump_requested = 1;
+    }
+  }
+
+  TraceDumper::TraceDumper (const ros::NodeHandle& nh)
+  {
+    ros::NodeHandle n(nh);
+
+    std::string node = ros::this_node::getName();
+    std::string default_file = node;
+    for(size_t i = 0; i < default_file.size(); i++)
+      if(default_file[i] == '/')
+        default_file[i] = '_';
+    default_file = "/tmp/" + default_file.substr(default_file.find_first_not_of('_')) + "_trace.json";
+
+    bool enabled;
+    int events;
+    n.param("enabled", enabled, false);
+    n.param("events", events, 16384);
+    n.param("file", filename_, default_file);
+    if(events > 0)
+      trace::capacity = events;
+    trace::enabled = enabled;
+    if(!enabled)
+      return;
+
+    service_ = n.advertiseService("dump", &TraceDumper::dumpCallback, this);
+
+    // the handler only sets a flag, the file is written from a timer
+    signal(SIGUSR2, &trace::onSignal);
+    signal_timer_ = n.createWallTimer(ros::WallDuration(0.2), &TraceDumper::signalCallback, this);
+    ROS_INFO("Tracing enabled, dumps go to %s", filename_.c_str());
+  }
+
+  bool TraceDumper::dump ()
+  {
+    if(!trace::dump(filename_, ros::this_node::getName()))
+    {
+      ROS_ERROR("Could not write trace to %s", filename_.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  bool TraceDumper::dumpCallback (std_srvs::Empty::Request& req, std_srvs::Empty::Response& res)
+  {
+    return dump();
+  }
+
+  void TraceDumper::signalCallback (const ros::WallTimerEvent& e)
+  {
+    if(trace::dump_requested)
+    {
+      trace::dump_requested = 0;
+      dump();
+    }
+  }
+}
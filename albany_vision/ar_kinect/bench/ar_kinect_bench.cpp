@@ -0,0 +1,99 @@
+/*
+ *  Microbenchmarks for the per-cloud work of ar_kinect: the PointCloud2
+ *  to image conversion done before marker detection, and the pose fit
+ *  for one marker. Built and run by "make bench", see CMakeLists.txt.
+ *
+ *  Michael Ferguson <ferguson@cs.albany.edu>
+ *  http://robotics.ils.albany.edu
+ */
+
+#include <boost/bind.hpp>
+
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/ros/conversions.h>
+#include <pcl/point_types.h>
+#include <pcl/registration/icp.h>
+#include <pcl/registration/registration.h>
+#include <cv_bridge/CvBridge.h>
+
+#include <albany_util/bench.h>
+
+typedef pcl::PointCloud<pcl::PointXYZRGB> PointCloud;
+
+static sensor_msgs::PointCloud2 msg;
+static PointCloud cloud;
+
+/* A 640x480 organized cloud of a textured plane 1m in front of the camera */
+static void buildCloud ()
+{
+  PointCloud c;
+  c.width = 640;
+  c.height = 480;
+  c.is_dense = true;
+  c.points.resize(c.width * c.height);
+  for(unsigned int v = 0; v < c.height; v++)
+  {
+    for(unsigned int u = 0; u < c.width; u++)
+    {
+      pcl::PointXYZRGB& p = c.points[v * c.width + u];
+      p.x = (u - 320.0) / 525.0;
+      p.y = (v - 240.0) / 525.0;
+      p.z = 1.0;
+      unsigned char g = ((u / 40 + v / 40) % 2) ? 255 : 0;
+      int rgb = (g << 16) | (g << 8) | g;
+      p.rgb = *reinterpret_cast<float*>(&rgb);
+    }
+  }
+  c.header.frame_id = "/camera_rgb_optical_frame";
+  pcl::toROSMsg(c, msg);
+}
+
+static void fromROSMsg ()
+{
+  pcl::fromROSMsg(msg, cloud);
+}
+
+static void toImage ()
+{
+  sensor_msgs::ImagePtr image_msg(new sensor_msgs::Image);
+  pcl::toROSMsg(cloud, *image_msg);
+}
+
+static void toOpenCV (sensor_msgs::CvBridge * bridge)
+{
+  sensor_msgs::ImagePtr image_msg(new sensor_msgs::Image);
+  pcl::toROSMsg(cloud, *image_msg);
+  bridge->imgMsgToCv(image_msg, "bgr8");
+}
+
+static void markerPose ()
+{
+  PointCloud marker, ideal;
+  marker.push_back(cloud.at(300, 220));
+  marker.push_back(cloud.at(340, 220));
+  marker.push_back(cloud.at(340, 260));
+  marker.push_back(cloud.at(300, 260));
+  double w = 0.08;
+  pcl::PointXYZRGB p;
+  p.z = 0;
+  p.x = -w/2; p.y = w/2;  ideal.push_back(p);
+  p.x = w/2;  p.y = w/2;  ideal.push_back(p);
+  p.x = w/2;  p.y = -w/2; ideal.push_back(p);
+  p.x = -w/2; p.y = -w/2; ideal.push_back(p);
+  Eigen::Matrix4f t;
+  pcl::estimateRigidTransformationSVD(marker, ideal, t);
+}
+
+int main (int argc, char **argv)
+{
+  buildCloud();
+  fromROSMsg();
+  sensor_msgs::CvBridge bridge;
+
+  albany_util::BenchReport report("ar_kinect", argc, argv);
+  report.run("cloud_from_ros_msg", &fromROSMsg);
+  report.run("cloud_to_image", &toImage);
+  report.run("cloud_to_opencv", boost::bind(&toOpenCV, &bridge));
+  report.run("marker_pose_svd", &markerPose);
+  return report.write() ? 0 : 1;
+}
@@ -55,6 +55,14 @@
 #include <ar_pose/ARMarker.h>
 #include <ar_kinect/object.h>
 
+#include <boost/thread.hpp>
+#include <albany_util/latest_value.h>
+#include <albany_util/thread_pool.h>
+#include <albany_util/trace.h>
+#include <albany_util/alloc_profile.h>
+#include <albany_util/alloc_diagnostics.h>
+#include <diagnostic_updater/diagnostic_updater.h>
+
 const std::string cloudTopic_ = "/camera/rgb/points";
 
 const double AR_TO_ROS = 0.001;
@@ -70,13 +78,28 @@ namespace ar_pose
 
   private:
     void arInit ();
+    void cloudCallback (const sensor_msgs::PointCloud2ConstPtr &);
+    void processLatest ();
     void getTransformationCallback (const sensor_msgs::PointCloud2ConstPtr &);
+    void diagnosticCallback (const ros::TimerEvent &);
 
     ros::NodeHandle n_;
     tf::TransformBroadcaster broadcaster_;
     ros::Subscriber cloud_sub_;
     ros::Publisher arMarkerPub_;
 
+    // **** newest cloud, handed from the subscriber to a pool task
+    albany_util::LatestValue<sensor_msgs::PointCloud2ConstPtr> cloud_;
+    boost::shared_ptr<albany_util::ThreadPool> pool_;
+    boost::mutex cloud_mutex_;
+    bool processing_;           // guarded by cloud_mutex_
+    unsigned long processed_;   // version of the last cloud processed
+
+    albany_util::TraceDumper tracer_;   // ~trace/enabled, ~trace/dump
+
+    diagnostic_updater::Updater updater_;
+    ros::Timer diagnostic_timer_;
+
     sensor_msgs::CvBridge bridge_;
 
     // **** for visualisation in rviz
@@ -59,7 +59,7 @@ namespace ar_pose
     return p;
   }
 
-  ARPublisher::ARPublisher (ros::NodeHandle & n):n_ (n), configured_(false)
+  ARPublisher::ARPublisher (ros::NodeHandle & n):n_ (n), processing_(false), processed_(0), configured_(false)
   {
     std::string path;
     std::string package_path = ros::package::getPath (ROS_PACKAGE_NAME);
@@ -97,7 +97,9 @@ namespace ar_pose
     // **** subscribe
 
     configured_ = false;
-    cloud_sub_ = n_.subscribe(cloudTopic_, 1, &ARPublisher::getTransformationCallback, this);
+    // clouds are processed on the shared pool (~pool/threads, ~pool/cpus, ~pool/nice)
+    pool_.reset (new albany_util::ThreadPool (ros::NodeHandle ("~pool"), 1));
+    cloud_sub_ = n_.subscribe(cloudTopic_, 1, &ARPublisher::cloudCallback, this);
 
     // **** advertise 
 
@@ -106,14 +108,28 @@ namespace ar_pose
     {
 		rvizMarkerPub_ = n_.advertise < visualization_msgs::Marker > ("visualization_marker", 0);
 	 }
+
+    // **** diagnostics
+
+    updater_.setHardwareID ("none");
+    updater_.add ("Allocations", &albany_util::allocDiagnostics);
+    diagnostic_timer_ = n_.createTimer (ros::Duration (1.0), &ARPublisher::diagnosticCallback, this);
   }
 
   ARPublisher::~ARPublisher (void)
   {
+    cloud_sub_.shutdown ();
+    pool_.reset ();             // finishes the cloud in progress
+
     arVideoCapStop ();
     arVideoClose ();
   }
 
+  void ARPublisher::diagnosticCallback (const ros::TimerEvent & event)
+  {
+    updater_.update ();
+  }
+
   /* 
    * Setup artoolkit
    */
@@ -134,10 +150,52 @@ namespace ar_pose
   }
 
   /* 
-   * One and only one callback, now takes cloud, does everything else needed. 
+   * Only hands the cloud over, so the subscriber never queues behind
+   * marker detection. Clouds that arrive while one is being processed
+   * replace each other, only the newest is ever processed.
+   */
+  void ARPublisher::cloudCallback (const sensor_msgs::PointCloud2ConstPtr & msg)
+  {
+    ALBANY_TRACE ("ar_kinect/cloudCallback");
+    ALBANY_ALLOC_SCOPE ("cloudCallback");
+    cloud_.set (msg);
+    boost::mutex::scoped_lock lock (cloud_mutex_);
+    if (!processing_)
+    {
+      processing_ = true;
+      pool_->post (boost::bind (&ARPublisher::processLatest, this));
+    }
+  }
+
+  /*
+   * Pool task, processes the newest cloud until no newer one has arrived.
+   * At most one runs at a time, ARToolkit is not reentrant.
+   */
+  void ARPublisher::processLatest ()
+  {
+    while (true)
+    {
+      {
+        boost::mutex::scoped_lock lock (cloud_mutex_);
+        if (cloud_.version () == processed_)
+        {
+          processing_ = false;
+          return;
+        }
+      }
+      sensor_msgs::PointCloud2ConstPtr msg = cloud_.get (&processed_);
+      if (msg)
+        getTransformationCallback (msg);
+    }
+  }
+
+  /* 
+   * Takes the newest cloud, does everything else needed. 
    */
   void ARPublisher::getTransformationCallback (const sensor_msgs::PointCloud2ConstPtr & msg)
   {
+    ALBANY_TRACE ("ar_kinect/getTransformationCallback");
+    ALBANY_ALLOC_SCOPE ("getTransformationCallback");
     sensor_msgs::ImagePtr image_msg(new sensor_msgs::Image);
     ARUint8 *dataPtr;
     ARMarkerInfo *marker_info;
@@ -0,0 +1,126 @@
+/**
+
+\author Michael Ferguson
+
+@b Microbenchmarks for the release path of camera_turnpike: serializing
+frames for republishing, the shared memory hand-off, the automatic
+trigger tests and history decimation. Built and run by "make bench",
+see CMakeLists.txt.
+
+**/
+
+#include "ros/ros.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/PointCloud2.h"
+
+#include "camera_turnpike/triggers.h"
+#include "camera_turnpike/history.h"
+#include "camera_turnpike/serialize.h"
+#include "camera_turnpike/shared_memory.h"
+
+#include "albany_util/bench.h"
+
+#include <vector>
+#include <boost/bind.hpp>
+
+static sensor_msgs::Image image;
+static sensor_msgs::PointCloud2 cloud;
+
+/* Frames the size of a Kinect's: 640x480 rgb8, and a matching xyz+rgb cloud */
+static void buildFrames ()
+{
+    image.header.frame_id = "/camera_rgb_optical_frame";
+    image.width = 640;
+    image.height = 480;
+    image.encoding = "rgb8";
+    image.step = image.width * 3;
+    image.data.resize(image.step * image.height);
+    for(size_t i = 0; i < image.data.size(); i++)
+        image.data[i] = (i * 7) & 0xff;
+
+    cloud.header = image.header;
+    cloud.width = 640;
+    cloud.height = 480;
+    const char * names[] = {"x", "y", "z", "rgb"};
+    for(int i = 0; i < 4; i++){
+        sensor_msgs::PointField f;
+        f.name = names[i];
+        f.offset = i * 4;
+        f.datatype = sensor_msgs::PointField::FLOAT32;
+        f.count = 1;
+        cloud.fields.push_back(f);
+    }
+    cloud.point_step = 16;
+    cloud.row_step = cloud.point_step * cloud.width;
+    cloud.data.resize(cloud.row_step * cloud.height);
+    for(size_t i = 0; i < cloud.width * cloud.height; i++){
+        float * p = reinterpret_cast<float*>(&cloud.data[i * cloud.point_step]);
+        p[0] = (i % cloud.width) * 0.002f - 0.64f;
+        p[1] = (i / cloud.width) * 0.002f - 0.48f;
+        p[2] = 1.0f;
+        p[3] = 0.0f;
+    }
+    cloud.is_dense = true;
+}
+
+static void serializeImage ()
+{
+    camera_turnpike::serialize(image);
+}
+
+static void serializeCloud ()
+{
+    camera_turnpike::serialize(cloud);
+}
+
+static void copyCloud ()
+{
+    sensor_msgs::PointCloud2Ptr copy(new sensor_msgs::PointCloud2(cloud));
+}
+
+static void sharedMemory ( camera_turnpike::SharedMemoryWriter * writer, topic_tools::ShapeShifter::ConstPtr * msg )
+{
+    camera_turnpike::SharedFrame frame;
+    writer->write(**msg, cloud.header, frame);
+}
+
+static void signature ()
+{
+    std::vector<float> s;
+    camera_turnpike::image_signature(image, s);
+}
+
+static void centroid ()
+{
+    double c[3];
+    camera_turnpike::cloud_centroid(cloud, c);
+}
+
+static void decimateCloud ()
+{
+    camera_turnpike::decimate_cloud(cloud, 2);
+}
+
+static void decimateImage ()
+{
+    camera_turnpike::decimate_image(image, 2);
+}
+
+int main (int argc, char **argv)
+{
+    buildFrames();
+    topic_tools::ShapeShifter::ConstPtr serialized = camera_turnpike::serialize(cloud);
+    camera_turnpike::SharedMemoryWriter writer("/camera_turnpike_bench", cloud.data.size() + 4096, 4);
+
+    albany_util::BenchReport report("camera_turnpike", argc, argv);
+    report.run("serialize_image", &serializeImage);
+    report.run("serialize_cloud", &serializeCloud);
+    report.run("copy_cloud", &copyCloud);
+    if(writer.ok())
+        report.run("shared_memory_write_cloud", boost::bind(&sharedMemory, &writer, &serialized));
+    report.run("image_signature", &signature);
+    report.run("cloud_centroid", &centroid);
+    report.run("decimate_cloud", &decimateCloud);
+    report.run("decimate_image", &decimateImage);
+    return report.write() ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/**
+
+\author Michael Ferguson
+
+@b Memory-budgeted look-back of recent frames. Recent frames are kept at
+full resolution, older ones are progressively decimated in the
+background, and the oldest are dropped to stay within a byte budget.
+
+**/
+
+#ifndef CAMERA_TURNPIKE_HISTORY_H
+#define CAMERA_TURNPIKE_HISTORY_H
+
+#include <deque>
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include "ros/ros.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/PointCloud2.h"
+
+namespace camera_turnpike
+{
+  /* 
+   * Keep every factor'th row and column of an image
+   */
+  sensor_msgs::ImagePtr decimate_image ( const sensor_msgs::Image& image, int factor );
+
+  /* 
+   * Keep every factor'th row and column of an organized cloud, or every
+   * factor^2'th point of an unorganized one
+   */
+  sensor_msgs::PointCloud2Ptr decimate_cloud ( const sensor_msgs::PointCloud2& cloud, int factor );
+
+  struct HistoryFrame
+  {
+    sensor_msgs::ImageConstPtr image;
+    sensor_msgs::PointCloud2ConstPtr cloud;
+    int level;              // times decimated
+    size_t bytes;
+  };
+
+  class FrameHistory
+  {
+  public:
+    /*
+     * Frames older than full_res_age are decimated by 2 in each dimension,
+     * and again each time their age grows by another factor of 4, up to
+     * max_level times. Frames older than length, and the oldest frames
+     * beyond budget bytes, are dropped.
+     */
+    FrameHistory (double length, double full_res_age, int max_level, size_t budget);
+    ~FrameHistory ();
+
+    void add (const sensor_msgs::ImageConstPtr& image, const sensor_msgs::PointCloud2ConstPtr& cloud);
+
+    /* Write all held frames to a bag, under image_topic and cloud_topic */
+    bool save (const std::string& filename, const std::string& image_topic, const std::string& cloud_topic);
+
+    size_t bytes ();
+    size_t size ();
+
+  private:
+    void compactLoop ();
+    void compact ();
+    void trim ();
+
+    double length_;
+    double full_res_age_;
+    int max_level_;
+    size_t budget_;
+
+    boost::mutex mutex_;
+    std::deque<HistoryFrame> frames_;
+    size_t bytes_;
+
+    boost::thread compactor_;
+  };
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+
+\author Michael Ferguson
+
+@b Serialization used by camera_turnpike to publish a released frame,
+shared with the benchmarks.
+
+**/
+
+#ifndef CAMERA_TURNPIKE_SERIALIZE_H
+#define CAMERA_TURNPIKE_SERIALIZE_H
+
+#include "ros/ros.h"
+#include "topic_tools/shape_shifter.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/shared_array.hpp>
+
+namespace camera_turnpike
+{
+  /*
+   * Serialize a message once into a ShapeShifter, which publishes by
+   * copying its bytes rather than walking the message again
+   */
+  template<class M>
+  topic_tools::ShapeShifter::ConstPtr serialize ( const M& msg )
+  {
+    uint32_t length = ros::serialization::serializationLength(msg);
+    boost::shared_array<uint8_t> buffer(new uint8_t[length]);
+    ros::serialization::OStream out(buffer.get(), length);
+    ros::serialization::serialize(out, msg);
+
+    boost::shared_ptr<topic_tools::ShapeShifter> shifter(new topic_tools::ShapeShifter);
+    shifter->morph(ros::message_traits::md5sum(msg), ros::message_traits::datatype(msg),
+                   ros::message_traits::definition(msg), "");
+    ros::serialization::IStream in(buffer.get(), length);
+    shifter->read(in);
+    return shifter;
+  }
+}
+
+#endif
@@ -0,0 +1,137 @@
+/**
+
+\author Michael Ferguson
+
+@b Shared memory hand-off of released frames to consumers on the same
+host. The writer keeps a ring of fixed size slots in a POSIX shared
+memory segment, each slot being an 8 byte sequence followed by a
+serialized message. The sequence is odd while a slot is being written,
+so readers can tell if a slot was reused under them.
+
+**/
+
+#ifndef CAMERA_TURNPIKE_SHARED_MEMORY_H
+#define CAMERA_TURNPIKE_SHARED_MEMORY_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <sys/types.h>
+
+#include "ros/ros.h"
+#include "ros/serialization.h"
+#include "camera_turnpike/SharedFrame.h"
+
+namespace camera_turnpike
+{
+  /* Slot header, holds the slot sequence */
+  const size_t SHM_SLOT_HEADER = sizeof(uint64_t);
+
+  class SharedMemoryWriter
+  {
+  public:
+    SharedMemoryWriter (const std::string& segment, size_t slot_size, int slots);
+    ~SharedMemoryWriter ();
+
+    bool ok () const { return base_ != NULL; }
+
+    /*
+     * Serialize a message into the next slot and fill in its descriptor.
+     * Returns false if it does not fit in a slot. The message may be an
+     * already serialized topic_tools::ShapeShifter, which is then copied
+     * as is, hence the header being passed separately.
+     */
+    template<class M>
+    bool write (const M& msg, const std_msgs::Header& header, SharedFrame& frame)
+    {
+      uint32_t size = ros::serialization::serializationLength(msg);
+      if(!ok() || size + SHM_SLOT_HEADER > slot_size_)
+        return false;
+
+      uint8_t * slot = beginSlot(frame);
+      ros::serialization::OStream stream(slot + SHM_SLOT_HEADER, size);
+      ros::serialization::serialize(stream, msg);
+      endSlot(slot, frame);
+
+      frame.header = header;
+      frame.size = size;
+      frame.datatype = ros::message_traits::datatype(msg);
+      frame.md5sum = ros::message_traits::md5sum(msg);
+      return true;
+    }
+
+  private:
+    uint8_t * beginSlot (SharedFrame& frame);
+    void endSlot (uint8_t * slot, const SharedFrame& frame);
+
+    std::string segment_;
+    size_t slot_size_;
+    int slots_;
+    int next_;
+    uint64_t sequence_;
+    size_t length_;
+    uint8_t * base_;
+  };
+
+  class SharedMemoryReader
+  {
+  public:
+    ~SharedMemoryReader ();
+
+    /*
+     * Pointer to the serialized message a descriptor refers to, for
+     * consumers which parse the bytes in place. Check valid() once done;
+     * the pointer is not to be used after it returned false.
+     */
+    const uint8_t * data (const SharedFrame& frame);
+
+    /*
+     * True while the slot still holds the message of this descriptor.
+     * On a mismatch the segment is looked up again, and remapped if the
+     * writer restarted and created it anew.
+     */
+    bool valid (const SharedFrame& frame);
+
+    /*
+     * Deserialize the message a descriptor refers to. Returns false if
+     * the segment is missing or the slot was reused before we finished.
+     * The slot is copied out and checked before parsing, as a writer
+     * lapping us can leave lengths in it which point past the slot.
+     */
+    template<class M>
+    bool read (const SharedFrame& frame, M& msg)
+    {
+      const uint8_t * bytes = data(frame);
+      if(!bytes || frame.md5sum != ros::message_traits::md5sum(msg))
+        return false;
+      std::vector<uint8_t> copy(bytes, bytes + frame.size);
+      if(!valid(frame))
+        return false;
+      try
+      {
+        ros::serialization::IStream stream(copy.empty() ? NULL : &copy[0], copy.size());
+        ros::serialization::deserialize(stream, msg);
+      }
+      catch(ros::Exception& e)
+      {
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    struct Mapping
+    {
+      const uint8_t * base;
+      size_t length;
+      ino_t inode;        // of the segment mapped, a new one has another
+    };
+    /* Map a segment once, or with refresh, again if it was replaced */
+    const Mapping * map (const std::string& segment, bool refresh = false);
+    bool matches (const Mapping * m, const SharedFrame& frame) const;
+
+    std::map<std::string, Mapping> mappings_;
+  };
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+
+\author Michael Ferguson
+
+@b Cheap in-process tests used by camera_turnpike to decide when to
+release a frame on its own.
+
+**/
+
+#ifndef CAMERA_TURNPIKE_TRIGGERS_H
+#define CAMERA_TURNPIKE_TRIGGERS_H
+
+#include <vector>
+
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/PointCloud2.h"
+
+namespace camera_turnpike
+{
+  /* Size of the thumbnail used to detect scene changes */
+  const int SIGNATURE_COLS = 16;
+  const int SIGNATURE_ROWS = 12;
+
+  /* 
+   * Sample a coarse grayscale thumbnail of an 8-bit image. Returns false
+   * if the image is empty or not laid out as 8-bit channels.
+   */
+  bool image_signature ( const sensor_msgs::Image& image, std::vector<float>& signature );
+
+  /* 
+   * Mean absolute difference between two thumbnails, in gray levels (0-255)
+   */
+  double signature_distance ( const std::vector<float>& a, const std::vector<float>& b );
+
+  /*
+   * Centroid of roughly max_samples evenly spaced finite points of a
+   * cloud with float32 x/y/z fields. Returns false if there are none.
+   */
+  bool cloud_centroid ( const sensor_msgs::PointCloud2& cloud, double centroid[3], int max_samples = 1000 );
+}
+
+#endif
@@ -4,6 +4,10 @@
 
 @b Offers a service to release a single depth/rgb image onto an alternate topic. 
 
+Callbacks and services run on an AsyncSpinner. The latest messages are
+held in albany_util::LatestValue slots, which are read without waiting,
+so a trigger never waits behind a cloud that is still arriving.
+
 **/
 
 #include "ros/ros.h"
@@ -13,22 +17,195 @@
 #include "sensor_msgs/PointCloud2.h"
 
 #include "pcl/io/io.h"
+#include "pcl/filters/passthrough.h"
+#include "pcl/filters/voxel_grid.h"
+
+#include "topic_tools/shape_shifter.h"
+#include "diagnostic_updater/diagnostic_updater.h"
+
+#include "camera_turnpike/triggers.h"
+#include "camera_turnpike/Capture.h"
+#include "camera_turnpike/shared_memory.h"
+#include "camera_turnpike/history.h"
+#include "camera_turnpike/serialize.h"
+
+#include "albany_util/latest_value.h"
+#include "albany_util/thread_pool.h"
+#include "albany_util/trace.h"
+#include "albany_util/alloc_profile.h"
+#include "albany_util/alloc_diagnostics.h"
+
+#include <math.h>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+/*
+ * An extra topic which is held and released still serialized
+ */
+struct Passthrough
+{
+    std::string                             topic;
+    ros::Subscriber                         sub;        // guarded by state_mutex_
+    ros::Publisher                          pub;        // guarded by state_mutex_
+    albany_util::LatestValue<topic_tools::ShapeShifter::ConstPtr> msg;
+    bool                                    unreleased; // guarded by stats_mutex_
+};
+
+/*
+ * Serialized form of the last released image or cloud. It is built on
+ * the first release of a held frame, so that repeated releases of the
+ * same frame cost one serialization (and one crop/voxel pass).
+ */
+template<class M>
+struct ReleaseCache
+{
+    boost::mutex                            mutex;
+    boost::shared_ptr<M const>              source;     // held message it was built from
+    boost::shared_ptr<M const>              output;     // after any processing
+    topic_tools::ShapeShifter::ConstPtr     serialized;
+};
+
+/*
+ * Release statistics, reported as diagnostics
+ */
+struct ReleaseStats
+{
+    ReleaseStats() : releases(0), last_latency(0), max_latency(0), total_latency(0),
+                     image_age(0), cloud_age(0), arrived(0), overwritten(0),
+                     last_arrived(0), last_overwritten(0) {}
+
+    int     releases;
+    double  last_latency;       // trigger request to publish completion (s)
+    double  max_latency;
+    double  total_latency;
+    double  image_age;          // age of the released frames (s)
+    double  cloud_age;
+    int     arrived;            // frames since the last trigger
+    int     overwritten;        // frames replaced before being released
+    int     last_arrived;       // ...and the same, between the last two triggers
+    int     last_overwritten;
+};
 
 class CameraTurnpike
 {
   public:
-    CameraTurnpike(ros::NodeHandle & n):n_ (n)
+    CameraTurnpike(ros::NodeHandle & n):rgb_unreleased_(false), depth_unreleased_(false), n_ (n),
+                                         armed_(false), release_pending_(false), processing_(false), shutdown_(false),
+                                         have_centroid_(false), have_reference_centroid_(false)
     {
         ros::NodeHandle nh("~");
 
-        rgb_sub_ = n.subscribe("/camera/rgb/image_color", 10, &CameraTurnpike::rgb_cb, this);
-        depth_sub_ = n.subscribe("/camera/rgb/points", 10, &CameraTurnpike::depth_cb, this);
+        // optional processing of released clouds
+        nh.param("crop", crop_, false);
+        nh.param("crop_min_x", crop_min_[0], -1.0);
+        nh.param("crop_min_y", crop_min_[1], -1.0);
+        nh.param("crop_min_z", crop_min_[2], 0.0);
+        nh.param("crop_max_x", crop_max_[0], 1.0);
+        nh.param("crop_max_y", crop_max_[1], 1.0);
+        nh.param("crop_max_z", crop_max_[2], 2.0);
+        nh.param("voxel_size", voxel_size_, 0.0);
+
+        // in lazy mode we only subscribe to the camera while armed
+        nh.param("lazy", lazy_, false);
+        nh.param("warm_window", warm_window_, 0.0);
+
+        // release on our own when the scene changes ("scene_change"), the cloud
+        // moves ("centroid"), or anything is published on ~trigger_topic ("topic")
+        nh.param("auto_trigger", auto_trigger_, std::string(""));
+        nh.param("scene_change_threshold", scene_change_threshold_, 20.0);
+        nh.param("centroid_threshold", centroid_threshold_, 0.05);
+        nh.param("auto_trigger_min_interval", auto_min_interval_, 1.0);
+        if(!auto_trigger_.empty() && auto_trigger_ != "scene_change" && auto_trigger_ != "centroid" && auto_trigger_ != "topic"){
+            ROS_ERROR("Unknown auto_trigger '%s', ignoring", auto_trigger_.c_str());
+            auto_trigger_.clear();
+        }
+
+        // any other topics to hold, of any type, are republished under ~
+        XmlRpc::XmlRpcValue topics;
+        if(nh.getParam("topics", topics)){
+            ROS_ASSERT(topics.getType() == XmlRpc::XmlRpcValue::TypeArray);
+            for(int i = 0; i < topics.size(); i++){
+                ROS_ASSERT(topics[i].getType() == XmlRpc::XmlRpcValue::TypeString);
+                Passthrough p;
+                p.topic = static_cast<std::string>(topics[i]);
+                p.unreleased = false;
+                passthroughs_.push_back(p);
+                ROS_INFO("Holding %s", p.topic.c_str());
+            }
+        }
 
         rgb_pub_ = nh.advertise<sensor_msgs::Image>("image", 10);
         depth_pub_ = nh.advertise<sensor_msgs::PointCloud2>("points", 10);
 
+        // optionally hand released frames to local consumers through shared memory
+        bool shared_memory;
+        nh.param("shared_memory", shared_memory, false);
+        if(shared_memory){
+            double slot_mb;
+            int slots;
+            nh.param("shm_slot_size", slot_mb, 16.0);
+            nh.param("shm_slots", slots, 4);
+            std::string segment = ros::this_node::getName();
+            std::replace(segment.begin()+1, segment.end(), '/', '_');
+            rgb_shm_.reset(new camera_turnpike::SharedMemoryWriter(segment + "_image", slot_mb*1024*1024, slots));
+            depth_shm_.reset(new camera_turnpike::SharedMemoryWriter(segment + "_points", slot_mb*1024*1024, slots));
+            rgb_shm_pub_ = nh.advertise<camera_turnpike::SharedFrame>("image_shm", 10);
+            depth_shm_pub_ = nh.advertise<camera_turnpike::SharedFrame>("points_shm", 10);
+        }
+
+        // look-back of recent frames for debugging, see history.h
+        bool history;
+        nh.param("history", history, false);
+        if(history){
+            double length, full_res_age, budget_mb;
+            int levels;
+            nh.param("history_rate", history_rate_, 2.0);
+            nh.param("history_length", length, 30.0);
+            nh.param("history_full_res_age", full_res_age, 2.0);
+            nh.param("history_levels", levels, 2);
+            nh.param("history_budget", budget_mb, 200.0);
+            nh.param("history_bag", history_bag_, std::string("turnpike_history.bag"));
+            history_.reset(new camera_turnpike::FrameHistory(length, full_res_age, levels, budget_mb*1024*1024));
+            save_history_service_ = nh.advertiseService("save_history", &CameraTurnpike::save_history_callback, this);
+        }
+
+        // clouds are cropped/downsampled away from the callback thread, on
+        // the shared pool (~pool/threads, ~pool/cpus, ~pool/nice)
+        if(crop_ || voxel_size_ > 0)
+            pool_.reset(new albany_util::ThreadPool(ros::NodeHandle("~pool"), 1));
+
         // advertise service to copy from input to output topics
         service_ = nh.advertiseService("trigger", &CameraTurnpike::service_callback, this);
+        arm_service_ = nh.advertiseService("arm", &CameraTurnpike::arm_callback, this);
+        capture_service_ = nh.advertiseService("capture", &CameraTurnpike::capture_callback, this);
+        if(auto_trigger_ == "topic"){
+            std::string trigger_topic;
+            nh.param("trigger_topic", trigger_topic, std::string("trigger_in"));
+            trigger_sub_ = nh.subscribe<topic_tools::ShapeShifter>(trigger_topic, 1, &CameraTurnpike::trigger_cb, this);
+        }
+
+        updater_.setHardwareID("none");
+        updater_.add("Turnpike", this, &CameraTurnpike::diagnostics);
+        updater_.add("Allocations", &albany_util::allocDiagnostics);
+        diagnostic_timer_ = n_.createTimer(ros::Duration(1.0), &CameraTurnpike::diagnostic_cb, this);
+
+        if(lazy_ && warm_window_ > 0)
+            disarm_timer_ = n_.createTimer(ros::Duration(std::min(warm_window_, 0.1)), &CameraTurnpike::disarm_cb, this);
+
+        if(!lazy_){
+            boost::mutex::scoped_lock lock(state_mutex_);
+            arm();
+        }
+    }
+
+    ~CameraTurnpike()
+    {
+        {
+            boost::mutex::scoped_lock lock(pending_mutex_);
+            shutdown_ = true;
+        }
+        pool_.reset();
     }
 
     /* 
@@ -36,16 +213,120 @@ class CameraTurnpike
      */
     void depth_cb ( const sensor_msgs::PointCloud2ConstPtr& cloud )
     {
+        ALBANY_TRACE("turnpike/depth_cb");
+        ALBANY_ALLOC_SCOPE("depth_cb");
         //pcl::copyPointCloud(*cloud, depth_);
-        depth_ = cloud;
+        count_arrival(depth_unreleased_);
+        depth_.set(cloud);
+        frames_cond_.notify_all();
+        check_pending();
+
+        if(history_ && (cloud->header.stamp - last_history_).toSec() >= 1.0/history_rate_){
+            sensor_msgs::ImageConstPtr rgb = rgb_.get();
+            if(rgb){
+                history_->add(rgb, cloud);
+                last_history_ = cloud->header.stamp;
+            }
+        }
+
+        if(auto_trigger_ == "centroid"){
+            double centroid[3];
+            if(!camera_turnpike::cloud_centroid(*cloud, centroid))
+                return;
+            bool fire = false;
+            {
+                boost::mutex::scoped_lock lock(auto_mutex_);
+                std::copy(centroid, centroid+3, centroid_);
+                have_centroid_ = true;
+                if(!have_reference_centroid_){
+                    std::copy(centroid, centroid+3, reference_centroid_);
+                    have_reference_centroid_ = true;
+                }
+                double dx = centroid[0] - reference_centroid_[0];
+                double dy = centroid[1] - reference_centroid_[1];
+                double dz = centroid[2] - reference_centroid_[2];
+                fire = sqrt(dx*dx + dy*dy + dz*dz) > centroid_threshold_ && auto_ready();
+            }
+            if(fire){
+                ROS_DEBUG("Cloud centroid moved, releasing");
+                release(ros::WallTime::now());
+            }
+        }
     }
 
     /* 
      * Capture latest rgb image
      */
-    void rgb_cb ( const sensor_msgs::Image& image )
+    void rgb_cb ( const sensor_msgs::ImageConstPtr& image )
+    {
+        ALBANY_TRACE("turnpike/rgb_cb");
+        ALBANY_ALLOC_SCOPE("rgb_cb");
+        count_arrival(rgb_unreleased_);
+        rgb_.set(image);
+        frames_cond_.notify_all();
+        check_pending();
+
+        if(auto_trigger_ == "scene_change"){
+            std::vector<float> signature;
+            if(!camera_turnpike::image_signature(*image, signature))
+                return;
+            bool fire = false;
+            {
+                boost::mutex::scoped_lock lock(auto_mutex_);
+                signature_.swap(signature);
+                if(reference_signature_.empty())
+                    reference_signature_ = signature_;
+                fire = camera_turnpike::signature_distance(signature_, reference_signature_) > scene_change_threshold_ && auto_ready();
+            }
+            if(fire){
+                ROS_DEBUG("Scene changed, releasing");
+                release(ros::WallTime::now());
+            }
+        }
+    }
+
+    /*
+     * Rate limit for automatic releases, called with auto_mutex_ held
+     */
+    bool auto_ready()
     {
-        rgb_ = image;
+        ros::WallTime now = ros::WallTime::now();
+        if((now - last_auto_release_).toSec() < auto_min_interval_)
+            return false;
+        last_auto_release_ = now;
+        return true;
+    }
+
+    /*
+     * Capture latest message on an extra topic, output is advertised
+     * once the type is known
+     */
+    void passthrough_cb ( const topic_tools::ShapeShifter::ConstPtr& msg, size_t index )
+    {
+        ALBANY_TRACE("turnpike/passthrough_cb");
+        ALBANY_ALLOC_SCOPE("passthrough_cb");
+        Passthrough& p = passthroughs_[index];
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            if(!p.pub){
+                ros::NodeHandle nh("~");
+                std::string name = p.topic;
+                if(!name.empty() && name[0] == '/')
+                    name.erase(0, 1);
+                p.pub = msg->advertise(nh, name, 10);
+            }
+        }
+        count_arrival(p.unreleased);
+        p.msg.set(msg);
+    }
+
+    void count_arrival ( bool& unreleased )
+    {
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        stats_.arrived++;
+        if(unreleased)
+            stats_.overwritten++;
+        unreleased = true;
     }
 
     /*
@@ -53,24 +334,569 @@ class CameraTurnpike
      */ 
     bool service_callback ( std_srvs::Empty::Request& request, std_srvs::Empty::Response& response )
     {
-        if(depth_){
-            rgb_pub_.publish(rgb_);
-            depth_pub_.publish(depth_);
+        ALBANY_TRACE("turnpike/trigger");
+        trigger(ros::WallTime::now());
+        return true;
+    }
+
+    /*
+     * Any message on the trigger topic acts like a call to the service
+     */
+    void trigger_cb ( const topic_tools::ShapeShifter::ConstPtr& msg )
+    {
+        ALBANY_TRACE("turnpike/trigger_cb");
+        trigger(ros::WallTime::now());
+    }
+
+    void trigger ( const ros::WallTime& trigger_time )
+    {
+        if(depth_.get() && rgb_.get()){
+            release(trigger_time);
+        }else if(lazy_){
+            // not armed yet, release as soon as a fresh image and cloud arrive
+            ROS_DEBUG("Trigger while not armed, release deferred until frames arrive");
+            boost::mutex::scoped_lock lock(state_mutex_);
+            arm();
+            release_pending_ = true;
+            pending_trigger_time_ = trigger_time;
         }else{
             ROS_WARN("No image/cloud received, skipping re-publish");
         }
+    }
+
+    /*
+     * Service which returns the latest image and cloud directly
+     */
+    bool capture_callback ( camera_turnpike::Capture::Request& request, camera_turnpike::Capture::Response& response )
+    {
+        ALBANY_TRACE("turnpike/capture");
+        ros::WallTime trigger_time = ros::WallTime::now();
+        sensor_msgs::ImageConstPtr rgb = rgb_.get();
+        sensor_msgs::PointCloud2ConstPtr depth = depth_.get();
+        if((!rgb || !depth) && lazy_){
+            // arm and wait for a fresh pair, callbacks run on other spinner threads
+            ros::WallTime deadline = trigger_time + ros::WallDuration(request.timeout);
+            boost::mutex::scoped_lock lock(state_mutex_);
+            arm();
+            while((!rgb || !depth) && ros::WallTime::now() < deadline && ros::ok()){
+                // callbacks notify without the lock, so wait in short slices
+                frames_cond_.timed_wait(lock, boost::posix_time::milliseconds(50));
+                rgb = rgb_.get();
+                depth = depth_.get();
+            }
+        }
+        if(!rgb || !depth){
+            ROS_WARN("No image/cloud received, cannot capture");
+            return false;
+        }
+
+        response.image = *rgb;
+        sensor_msgs::PointCloud2ConstPtr points;
+        cached(depth_cache_, depth, &points);
+        response.points = *points;
+        record_latency(trigger_time);
+        note_release(rgb, depth);
+        finish_release();
+        return true;
+    }
+
+    /*
+     * Service which writes the frame history to ~history_bag
+     */
+    bool save_history_callback ( std_srvs::Empty::Request& request, std_srvs::Empty::Response& response )
+    {
+        ALBANY_TRACE("turnpike/save_history");
+        return history_->save(history_bag_, "image", "points");
+    }
+
+    /*
+     * Service which subscribes to the camera ahead of a trigger
+     */
+    bool arm_callback ( std_srvs::Empty::Request& request, std_srvs::Empty::Response& response )
+    {
+        ALBANY_TRACE("turnpike/arm");
+        if(lazy_){
+            boost::mutex::scoped_lock lock(state_mutex_);
+            arm();
+        }
         return true;
     }
 
+    /*
+     * Run a deferred release once both an image and a cloud are held
+     */
+    void check_pending()
+    {
+        ros::WallTime trigger_time;
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            if(!release_pending_ || !depth_.get() || !rgb_.get())
+                return;
+            release_pending_ = false;
+            trigger_time = pending_trigger_time_;
+        }
+        release(trigger_time);
+    }
+
+    /*
+     * Subscribe to the camera, restarting the warm window. Called with
+     * state_mutex_ held.
+     */
+    void arm()
+    {
+        if(!armed_){
+            rgb_sub_ = n_.subscribe("/camera/rgb/image_color", 10, &CameraTurnpike::rgb_cb, this);
+            depth_sub_ = n_.subscribe("/camera/rgb/points", 10, &CameraTurnpike::depth_cb, this);
+            for(size_t i = 0; i < passthroughs_.size(); i++)
+                passthroughs_[i].sub = n_.subscribe<topic_tools::ShapeShifter>(passthroughs_[i].topic, 10,
+                                         boost::bind(&CameraTurnpike::passthrough_cb, this, _1, i));
+            armed_ = true;
+        }
+        disarm_deadline_ = ros::Time::now() + ros::Duration(warm_window_);
+    }
+
+    /*
+     * Drop the camera subscriptions once the warm window has expired.
+     * This polls rather than using a one-shot timer, since stopping a
+     * timer blocks on its callback, which itself needs state_mutex_.
+     */
+    void disarm_cb ( const ros::TimerEvent& event )
+    {
+        std::vector<ros::Subscriber> dropped;
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            if(!armed_ || ros::Time::now() < disarm_deadline_)
+                return;
+            if(release_pending_){
+                ROS_WARN("No image/cloud received while armed, skipping re-publish");
+                release_pending_ = false;
+            }
+            disarm(dropped);
+        }
+        shutdown(dropped);
+    }
+
+    /*
+     * Unsubscribe and forget held frames. Called with state_mutex_ held,
+     * the subscribers are shut down by the caller once it is released,
+     * as shutdown waits for their callbacks which may need the lock.
+     */
+    void disarm ( std::vector<ros::Subscriber>& dropped )
+    {
+        dropped.push_back(rgb_sub_);
+        dropped.push_back(depth_sub_);
+        rgb_sub_ = ros::Subscriber();
+        depth_sub_ = ros::Subscriber();
+        for(size_t i = 0; i < passthroughs_.size(); i++){
+            dropped.push_back(passthroughs_[i].sub);
+            passthroughs_[i].sub = ros::Subscriber();
+        }
+        armed_ = false;
+        clear_held();
+    }
+
+    /*
+     * Forget held frames, they would be stale by the next trigger
+     */
+    void clear_held()
+    {
+        rgb_.reset();
+        depth_.reset();
+        for(size_t i = 0; i < passthroughs_.size(); i++)
+            passthroughs_[i].msg.reset();
+        clear_cache(rgb_cache_);
+        clear_cache(depth_cache_);
+    }
+
+    void shutdown ( std::vector<ros::Subscriber>& subs )
+    {
+        if(subs.empty())
+            return;
+        for(size_t i = 0; i < subs.size(); i++)
+            subs[i].shutdown();
+
+        // a callback may have stored a frame after disarm, but before shutdown
+        boost::mutex::scoped_lock lock(state_mutex_);
+        if(!armed_)
+            clear_held();
+    }
+
+    /*
+     * Copy the held image and cloud to the output topics, along with
+     * whatever has been held on the extra topics
+     */
+    void release ( const ros::WallTime& trigger_time )
+    {
+        ALBANY_TRACE("turnpike/release");
+        ALBANY_ALLOC_SCOPE("release");
+        sensor_msgs::ImageConstPtr rgb = rgb_.get();
+        sensor_msgs::PointCloud2ConstPtr depth = depth_.get();
+        if(!rgb || !depth)
+            return;     // disarmed under us
+
+        std::vector<ros::Publisher> pubs;
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            for(size_t i = 0; i < passthroughs_.size(); i++)
+                pubs.push_back(passthroughs_[i].pub);
+        }
+        for(size_t i = 0; i < passthroughs_.size(); i++){
+            // original bytes go straight back out
+            topic_tools::ShapeShifter::ConstPtr msg = passthroughs_[i].msg.get();
+            if(msg)
+                pubs[i].publish(msg);
+        }
+        publish_image(rgb);
+        note_release(rgb, depth);
+        if(pool_){
+            // hand off to the pool, a newer release replaces an unprocessed one
+            boost::mutex::scoped_lock lock(pending_mutex_);
+            pending_ = depth;
+            pending_release_time_ = trigger_time;
+            if(!processing_){
+                processing_ = true;
+                pool_->post(boost::bind(&CameraTurnpike::process_pending, this));
+            }
+        }else{
+            publish_cloud(depth);
+            record_latency(trigger_time);
+        }
+        finish_release();
+    }
+
+    /*
+     * Update trigger references and statistics for a released pair
+     */
+    void note_release ( const sensor_msgs::ImageConstPtr& rgb, const sensor_msgs::PointCloud2ConstPtr& depth )
+    {
+        {
+            // automatic triggers compare against what was last released
+            boost::mutex::scoped_lock lock(auto_mutex_);
+            reference_signature_ = signature_;
+            if(have_centroid_){
+                std::copy(centroid_, centroid_+3, reference_centroid_);
+                have_reference_centroid_ = true;
+            }
+        }
+        {
+            boost::mutex::scoped_lock lock(stats_mutex_);
+            ros::Time now = ros::Time::now();
+            stats_.image_age = (now - rgb->header.stamp).toSec();
+            stats_.cloud_age = (now - depth->header.stamp).toSec();
+            stats_.last_arrived = stats_.arrived;
+            stats_.last_overwritten = stats_.overwritten;
+            stats_.arrived = stats_.overwritten = 0;
+            rgb_unreleased_ = depth_unreleased_ = false;
+            for(size_t i = 0; i < passthroughs_.size(); i++)
+                passthroughs_[i].unreleased = false;
+        }
+    }
+
+    /*
+     * In lazy mode, drop the subscriptions or restart the warm window
+     */
+    void finish_release()
+    {
+        if(lazy_){
+            std::vector<ros::Subscriber> dropped;
+            {
+                boost::mutex::scoped_lock lock(state_mutex_);
+                if(warm_window_ > 0)
+                    arm();
+                else
+                    disarm(dropped);
+            }
+            shutdown(dropped);
+        }
+    }
+
+    /*
+     * Pool task which processes and publishes released clouds until
+     * none is pending. At most one runs at a time, so clouds go out in
+     * release order.
+     */
+    void process_pending()
+    {
+        ALBANY_TRACE("turnpike/process_pending");
+        while(true){
+            sensor_msgs::PointCloud2ConstPtr cloud;
+            ros::WallTime trigger_time;
+            {
+                boost::mutex::scoped_lock lock(pending_mutex_);
+                if(!pending_ || shutdown_){
+                    processing_ = false;
+                    return;
+                }
+                cloud.swap(pending_);
+                trigger_time = pending_release_time_;
+            }
+            publish_cloud(cloud);
+            record_latency(trigger_time);
+        }
+    }
+
+    void publish_image ( const sensor_msgs::ImageConstPtr& image )
+    {
+        topic_tools::ShapeShifter::ConstPtr serialized = cached(rgb_cache_, image);
+        rgb_pub_.publish(serialized);
+        if(rgb_shm_)
+            write_shared(*rgb_shm_, rgb_shm_pub_, *serialized, image->header);
+    }
+
+    /*
+     * Publish a held cloud, processing it first if required
+     */
+    void publish_cloud ( const sensor_msgs::PointCloud2ConstPtr& cloud )
+    {
+        sensor_msgs::PointCloud2ConstPtr output;
+        topic_tools::ShapeShifter::ConstPtr serialized = cached(depth_cache_, cloud, &output);
+        depth_pub_.publish(serialized);
+        if(depth_shm_)
+            write_shared(*depth_shm_, depth_shm_pub_, *serialized, output->header);
+    }
+
+    /*
+     * Look up the serialized form of a held message, building it if this
+     * is the first release of that message. The cache lock is held while
+     * building, so concurrent releases of the same frame wait for it
+     * rather than serializing it again.
+     */
+    template<class M>
+    topic_tools::ShapeShifter::ConstPtr cached ( ReleaseCache<M>& cache, const boost::shared_ptr<M const>& source,
+                                                 boost::shared_ptr<M const>* output = NULL )
+    {
+        boost::mutex::scoped_lock lock(cache.mutex);
+        if(cache.source != source){
+            cache.output = processed(source);
+            cache.serialized = camera_turnpike::serialize(*cache.output);
+            cache.source = source;
+        }
+        if(output)
+            *output = cache.output;
+        return cache.serialized;
+    }
+
+    template<class M>
+    void clear_cache ( ReleaseCache<M>& cache )
+    {
+        boost::mutex::scoped_lock lock(cache.mutex);
+        cache.source.reset();
+        cache.output.reset();
+        cache.serialized.reset();
+    }
+
+    sensor_msgs::ImageConstPtr processed ( const sensor_msgs::ImageConstPtr& image )
+    {
+        return image;
+    }
+
+    sensor_msgs::PointCloud2ConstPtr processed ( const sensor_msgs::PointCloud2ConstPtr& cloud )
+    {
+        if(crop_ || voxel_size_ > 0)
+            return process(cloud);
+        return cloud;
+    }
+
+    /*
+     * Copy a message into shared memory and publish its descriptor, only
+     * when someone is listening for descriptors
+     */
+    template<class M>
+    void write_shared ( camera_turnpike::SharedMemoryWriter& writer, ros::Publisher& pub, const M& msg,
+                        const std_msgs::Header& header )
+    {
+        if(pub.getNumSubscribers() == 0)
+            return;
+        camera_turnpike::SharedFramePtr frame(new camera_turnpike::SharedFrame);
+        {
+            boost::mutex::scoped_lock lock(shm_mutex_);
+            if(!writer.write(msg, header, *frame)){
+                ROS_WARN_THROTTLE(10, "Frame does not fit in a shared memory slot, increase ~shm_slot_size");
+                return;
+            }
+        }
+        pub.publish(frame);
+    }
+
+    void record_latency ( const ros::WallTime& trigger_time )
+    {
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        double latency = (ros::WallTime::now() - trigger_time).toSec();
+        stats_.releases++;
+        stats_.last_latency = latency;
+        stats_.total_latency += latency;
+        if(latency > stats_.max_latency)
+            stats_.max_latency = latency;
+    }
+
+    template<class M>
+    size_t cache_bytes ( ReleaseCache<M>& cache )
+    {
+        boost::mutex::scoped_lock lock(cache.mutex);
+        return cache.serialized ? cache.serialized->size() : 0;
+    }
+
+    void diagnostic_cb ( const ros::TimerEvent& event )
+    {
+        updater_.update();
+    }
+
+    /*
+     * Report release latency, frame age, buffer usage and dropped frames
+     */
+    void diagnostics ( diagnostic_updater::DiagnosticStatusWrapper& stat )
+    {
+        size_t held = 0;
+        sensor_msgs::ImageConstPtr rgb = rgb_.get();
+        if(rgb)
+            held += rgb->data.size();
+        sensor_msgs::PointCloud2ConstPtr depth = depth_.get();
+        if(depth)
+            held += depth->data.size();
+        for(size_t i = 0; i < passthroughs_.size(); i++){
+            topic_tools::ShapeShifter::ConstPtr msg = passthroughs_[i].msg.get();
+            if(msg)
+                held += msg->size();
+        }
+        bool armed;
+        {
+            boost::mutex::scoped_lock lock(state_mutex_);
+            armed = armed_;
+        }
+        {
+            boost::mutex::scoped_lock lock(pending_mutex_);
+            if(pending_)
+                held += pending_->data.size();
+        }
+        held += cache_bytes(rgb_cache_) + cache_bytes(depth_cache_);
+
+        boost::mutex::scoped_lock lock(stats_mutex_);
+        stat.summary(diagnostic_msgs::DiagnosticStatus::OK, armed ? "Armed" : "Idle");
+        stat.add("Releases", stats_.releases);
+        stat.add("Last Release Latency (s)", stats_.last_latency);
+        stat.add("Max Release Latency (s)", stats_.max_latency);
+        stat.add("Mean Release Latency (s)", stats_.releases ? stats_.total_latency/stats_.releases : 0.0);
+        stat.add("Released Image Age (s)", stats_.image_age);
+        stat.add("Released Cloud Age (s)", stats_.cloud_age);
+        stat.add("Bytes Held", held);
+        stat.add("Frames Arrived Between Triggers", stats_.last_arrived);
+        stat.add("Frames Overwritten Between Triggers", stats_.last_overwritten);
+        stat.add("Frames Arrived Since Trigger", stats_.arrived);
+        stat.add("Frames Overwritten Since Trigger", stats_.overwritten);
+        if(history_){
+            stat.add("History Frames", history_->size());
+            stat.add("History Bytes", history_->bytes());
+        }
+    }
+
+    /*
+     * Crop a cloud to the workspace box, then voxel-downsample it
+     */
+    sensor_msgs::PointCloud2ConstPtr process ( const sensor_msgs::PointCloud2ConstPtr& cloud )
+    {
+        sensor_msgs::PointCloud2ConstPtr out = cloud;
+        if(crop_){
+            const char * axes[] = {"x", "y", "z"};
+            for(int i = 0; i < 3; i++){
+                pcl::PassThrough<sensor_msgs::PointCloud2> pass;
+                pass.setInputCloud(out);
+                pass.setFilterFieldName(axes[i]);
+                pass.setFilterLimits(crop_min_[i], crop_max_[i]);
+                sensor_msgs::PointCloud2Ptr cropped(new sensor_msgs::PointCloud2);
+                pass.filter(*cropped);
+                cropped->header = cloud->header;
+                out = cropped;
+            }
+        }
+        if(voxel_size_ > 0){
+            pcl::VoxelGrid<sensor_msgs::PointCloud2> voxel;
+            voxel.setInputCloud(out);
+            voxel.setLeafSize(voxel_size_, voxel_size_, voxel_size_);
+            sensor_msgs::PointCloud2Ptr downsampled(new sensor_msgs::PointCloud2);
+            voxel.filter(*downsampled);
+            downsampled->header = cloud->header;
+            out = downsampled;
+        }
+        return out;
+    }
+
   private: 
-    sensor_msgs::Image                  rgb_;
+    albany_util::LatestValue<sensor_msgs::ImageConstPtr> rgb_;
+    bool                                rgb_unreleased_;
     ros::Subscriber                     rgb_sub_; 
     ros::Publisher                      rgb_pub_;
-    sensor_msgs::PointCloud2ConstPtr    depth_;
+    albany_util::LatestValue<sensor_msgs::PointCloud2ConstPtr> depth_;
+    bool                                depth_unreleased_;
     ros::Subscriber                     depth_sub_; 
     ros::Publisher                      depth_pub_;
     ros::NodeHandle                     n_;
     ros::ServiceServer                  service_;
+    ros::ServiceServer                  capture_service_;
+    boost::condition_variable           frames_cond_;
+    std::vector<Passthrough>            passthroughs_;
+
+    // serialized releases
+    ReleaseCache<sensor_msgs::Image>        rgb_cache_;
+    ReleaseCache<sensor_msgs::PointCloud2>  depth_cache_;
+
+    // shared memory hand-off
+    boost::shared_ptr<camera_turnpike::SharedMemoryWriter> rgb_shm_;
+    boost::shared_ptr<camera_turnpike::SharedMemoryWriter> depth_shm_;
+    ros::Publisher                      rgb_shm_pub_;
+    ros::Publisher                      depth_shm_pub_;
+    boost::mutex                        shm_mutex_;
+
+    // frame history
+    boost::shared_ptr<camera_turnpike::FrameHistory> history_;
+    double                              history_rate_;
+    ros::Time                           last_history_;
+    std::string                         history_bag_;
+    ros::ServiceServer                  save_history_service_;
+
+    // lazy subscription
+    bool                                lazy_;
+    double                              warm_window_;
+    boost::mutex                        state_mutex_;
+    bool                                armed_;
+    bool                                release_pending_;
+    ros::WallTime                       pending_trigger_time_;
+    ros::ServiceServer                  arm_service_;
+    ros::Timer                          disarm_timer_;
+    ros::Time                           disarm_deadline_;
+
+    // cloud processing
+    bool                                crop_;
+    double                              crop_min_[3];
+    double                              crop_max_[3];
+    double                              voxel_size_;
+    boost::shared_ptr<albany_util::ThreadPool> pool_;
+    boost::mutex                        pending_mutex_;
+    sensor_msgs::PointCloud2ConstPtr    pending_;
+    ros::WallTime                       pending_release_time_;
+    bool                                processing_;
+    bool                                shutdown_;
+
+    // condition-triggered release
+    std::string                         auto_trigger_;
+    double                              scene_change_threshold_;
+    double                              centroid_threshold_;
+    double                              auto_min_interval_;
+    ros::Subscriber                     trigger_sub_;
+    boost::mutex                        auto_mutex_;
+    std::vector<float>                  signature_;
+    std::vector<float>                  reference_signature_;
+    double                              centroid_[3];
+    double                              reference_centroid_[3];
+    bool                                have_centroid_;
+    bool                                have_reference_centroid_;
+    ros::WallTime                       last_auto_release_;
+
+    // instrumentation
+    diagnostic_updater::Updater         updater_;
+    ros::Timer                          diagnostic_timer_;
+    boost::mutex                        stats_mutex_;
+    ReleaseStats                        stats_;
+    albany_util::TraceDumper            tracer_;    // ~trace/enabled, ~trace/dump
 };
 
 int main (int argc, char **argv)
@@ -78,6 +904,12 @@ int main (int argc, char **argv)
   ros::init (argc, argv, "camera_turnpike");
   ros::NodeHandle n;
   CameraTurnpike turnpike(n);
-  ros::spin ();
+
+  // 0 threads means one per core
+  int threads;
+  ros::NodeHandle("~").param("spinner_threads", threads, 0);
+  ros::AsyncSpinner spinner(threads);
+  spinner.start();
+  ros::waitForShutdown();
   return 0;
 }
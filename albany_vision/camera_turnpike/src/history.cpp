@@ -0,0 +1,225 @@
+/**
+
+\author Michael Ferguson
+
+**/
+
+#include <math.h>
+#include <string.h>
+
+#include "rosbag/bag.h"
+#include "camera_turnpike/history.h"
+
+namespace camera_turnpike
+{
+  sensor_msgs::ImagePtr decimate_image ( const sensor_msgs::Image& image, int factor )
+  {
+    sensor_msgs::ImagePtr out(new sensor_msgs::Image);
+    out->header = image.header;
+    out->encoding = image.encoding;
+    out->is_bigendian = image.is_bigendian;
+    out->width = image.width / factor;
+    out->height = image.height / factor;
+    if(image.width == 0 || out->width == 0 || out->height == 0)
+      return out;
+
+    unsigned int bpp = image.step / image.width;
+    out->step = out->width * bpp;
+    out->data.resize(out->step * out->height);
+    for(unsigned int y = 0; y < out->height; y++)
+    {
+      const unsigned char * src = &image.data[y * factor * image.step];
+      unsigned char * dst = &out->data[y * out->step];
+      for(unsigned int x = 0; x < out->width; x++)
+        memcpy(dst + x * bpp, src + x * factor * bpp, bpp);
+    }
+    return out;
+  }
+
+  sensor_msgs::PointCloud2Ptr decimate_cloud ( const sensor_msgs::PointCloud2& cloud, int factor )
+  {
+    sensor_msgs::PointCloud2Ptr out(new sensor_msgs::PointCloud2);
+    out->header = cloud.header;
+    out->fields = cloud.fields;
+    out->is_bigendian = cloud.is_bigendian;
+    out->point_step = cloud.point_step;
+    out->is_dense = cloud.is_dense;
+
+    if(cloud.height > 1)
+    {
+      out->width = cloud.width / factor;
+      out->height = cloud.height / factor;
+      out->row_step = out->width * out->point_step;
+      out->data.resize(out->row_step * out->height);
+      for(unsigned int y = 0; y < out->height; y++)
+      {
+        const unsigned char * src = &cloud.data[y * factor * cloud.row_step];
+        unsigned char * dst = &out->data[y * out->row_step];
+        for(unsigned int x = 0; x < out->width; x++)
+          memcpy(dst + x * out->point_step, src + x * factor * cloud.point_step, out->point_step);
+      }
+    }
+    else
+    {
+      unsigned int stride = factor * factor;
+      out->height = 1;
+      out->width = cloud.width / stride;
+      out->row_step = out->width * out->point_step;
+      out->data.resize(out->row_step);
+      for(unsigned int x = 0; x < out->width; x++)
+        memcpy(&out->data[x * out->point_step], &cloud.data[x * stride * cloud.point_step], out->point_step);
+    }
+    return out;
+  }
+
+  static size_t frame_bytes ( const HistoryFrame& frame )
+  {
+    return frame.image->data.size() + frame.cloud->data.size();
+  }
+
+  FrameHistory::FrameHistory (double length, double full_res_age, int max_level, size_t budget):
+    length_(length), full_res_age_(full_res_age), max_level_(max_level), budget_(budget), bytes_(0)
+  {
+    compactor_ = boost::thread(boost::bind(&FrameHistory::compactLoop, this));
+  }
+
+  FrameHistory::~FrameHistory ()
+  {
+    compactor_.interrupt();
+    compactor_.join();
+  }
+
+  void FrameHistory::add (const sensor_msgs::ImageConstPtr& image, const sensor_msgs::PointCloud2ConstPtr& cloud)
+  {
+    HistoryFrame frame;
+    frame.image = image;
+    frame.cloud = cloud;
+    frame.level = 0;
+    frame.bytes = frame_bytes(frame);
+
+    boost::mutex::scoped_lock lock(mutex_);
+    frames_.push_back(frame);
+    bytes_ += frame.bytes;
+    trim();
+  }
+
+  size_t FrameHistory::bytes ()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return bytes_;
+  }
+
+  size_t FrameHistory::size ()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    return frames_.size();
+  }
+
+  void FrameHistory::compactLoop ()
+  {
+    try
+    {
+      while(true)
+      {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(250));
+        compact();
+      }
+    }
+    catch(boost::thread_interrupted&)
+    {
+    }
+  }
+
+  /*
+   * Decimate frames which have aged into the next level. The work is
+   * done without the lock, frames are only swapped in afterwards.
+   */
+  void FrameHistory::compact ()
+  {
+    ros::Time now = ros::Time::now();
+    std::deque<HistoryFrame> frames;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      frames = frames_;
+    }
+
+    for(size_t i = 0; i < frames.size(); i++)
+    {
+      HistoryFrame& frame = frames[i];
+      if(frame.level >= max_level_)
+        continue;
+      double age = (now - frame.cloud->header.stamp).toSec();
+      int level = 0;
+      for(double a = full_res_age_; age > a && level < max_level_; a *= 4)
+        level++;
+      if(level <= frame.level)
+        continue;
+
+      // decimate further from the level it is held at
+      int factor = 1 << level;
+      int from = 1 << frame.level;
+      HistoryFrame decimated;
+      decimated.image = decimate_image(*frame.image, factor/from);
+      decimated.cloud = decimate_cloud(*frame.cloud, factor/from);
+      decimated.level = level;
+      decimated.bytes = frame_bytes(decimated);
+
+      // swap in, unless it has been dropped meanwhile
+      boost::mutex::scoped_lock lock(mutex_);
+      for(size_t j = 0; j < frames_.size(); j++)
+      {
+        if(frames_[j].cloud == frame.cloud)
+        {
+          bytes_ -= frames_[j].bytes;
+          bytes_ += decimated.bytes;
+          frames_[j] = decimated;
+          break;
+        }
+      }
+    }
+
+    boost::mutex::scoped_lock lock(mutex_);
+    trim();
+  }
+
+  /*
+   * Drop frames past the look-back length or the budget, called with
+   * mutex_ held
+   */
+  void FrameHistory::trim ()
+  {
+    ros::Time now = ros::Time::now();
+    while(!frames_.empty() && (bytes_ > budget_ || (now - frames_.front().cloud->header.stamp).toSec() > length_))
+    {
+      bytes_ -= frames_.front().bytes;
+      frames_.pop_front();
+    }
+  }
+
+  bool FrameHistory::save (const std::string& filename, const std::string& image_topic, const std::string& cloud_topic)
+  {
+    std::deque<HistoryFrame> frames;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      frames = frames_;
+    }
+
+    try
+    {
+      rosbag::Bag bag(filename, rosbag::bagmode::Write);
+      for(size_t i = 0; i < frames.size(); i++)
+      {
+        bag.write(image_topic, frames[i].image->header.stamp, frames[i].image);
+        bag.write(cloud_topic, frames[i].cloud->header.stamp, frames[i].cloud);
+      }
+      bag.close();
+    }
+    catch(rosbag::BagException& e)
+    {
+      ROS_ERROR("Could not write history to %s: %s", filename.c_str(), e.what());
+      return false;
+    }
+    ROS_INFO("Wrote %d frames of history to %s", (int) frames.size(), filename.c_str());
+    return true;
+  }
+}
@@ -0,0 +1,145 @@
+/**
+
+\author Michael Ferguson
+
+**/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "camera_turnpike/shared_memory.h"
+
+namespace camera_turnpike
+{
+  SharedMemoryWriter::SharedMemoryWriter (const std::string& segment, size_t slot_size, int slots):
+    segment_(segment), slot_size_(slot_size), slots_(slots), next_(0),
+    sequence_(ros::WallTime::now().toNSec() & ~1ULL),   // stale descriptors from an earlier run never match
+    length_(slot_size * slots), base_(NULL)
+  {
+    int fd = shm_open(segment_.c_str(), O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+    {
+      ROS_ERROR("Could not open shared memory segment %s", segment_.c_str());
+      return;
+    }
+    if(ftruncate(fd, length_) < 0)
+    {
+      ROS_ERROR("Could not size shared memory segment %s", segment_.c_str());
+      close(fd);
+      return;
+    }
+    void * base = mmap(NULL, length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+    {
+      ROS_ERROR("Could not map shared memory segment %s", segment_.c_str());
+      return;
+    }
+    base_ = static_cast<uint8_t*>(base);
+  }
+
+  SharedMemoryWriter::~SharedMemoryWriter ()
+  {
+    if(base_)
+    {
+      munmap(base_, length_);
+      shm_unlink(segment_.c_str());
+    }
+  }
+
+  uint8_t * SharedMemoryWriter::beginSlot (SharedFrame& frame)
+  {
+    uint8_t * slot = base_ + next_ * slot_size_;
+    frame.segment = segment_;
+    frame.offset = next_ * slot_size_ + SHM_SLOT_HEADER;
+    frame.sequence = (sequence_ += 2);
+    next_ = (next_ + 1) % slots_;
+
+    // odd while writing
+    *reinterpret_cast<volatile uint64_t*>(slot) = frame.sequence - 1;
+    __sync_synchronize();
+    return slot;
+  }
+
+  void SharedMemoryWriter::endSlot (uint8_t * slot, const SharedFrame& frame)
+  {
+    __sync_synchronize();
+    *reinterpret_cast<volatile uint64_t*>(slot) = frame.sequence;
+  }
+
+  SharedMemoryReader::~SharedMemoryReader ()
+  {
+    for(std::map<std::string, Mapping>::iterator it = mappings_.begin(); it != mappings_.end(); it++)
+      munmap(const_cast<uint8_t*>(it->second.base), it->second.length);
+  }
+
+  const SharedMemoryReader::Mapping * SharedMemoryReader::map (const std::string& segment, bool refresh)
+  {
+    std::map<std::string, Mapping>::iterator it = mappings_.find(segment);
+    if(it != mappings_.end() && !refresh)
+      return &it->second;
+    const Mapping * mapped = (it != mappings_.end()) ? &it->second : NULL;
+
+    // between a writer exiting and the next starting there is nothing to
+    // swap to, keep what we have
+    int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+      return mapped;
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+    {
+      close(fd);
+      return mapped;
+    }
+    if(mapped)
+    {
+      if(st.st_ino == mapped->inode && (size_t) st.st_size == mapped->length)
+      {
+        close(fd);
+        return mapped;
+      }
+      // unlinked and created again, by a writer restarting
+      munmap(const_cast<uint8_t*>(mapped->base), mapped->length);
+      mappings_.erase(it);
+    }
+    void * base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+      return NULL;
+
+    Mapping m;
+    m.base = static_cast<const uint8_t*>(base);
+    m.length = st.st_size;
+    m.inode = st.st_ino;
+    return &(mappings_[segment] = m);
+  }
+
+  bool SharedMemoryReader::matches (const Mapping * m, const SharedFrame& frame) const
+  {
+    if(!m || frame.offset < SHM_SLOT_HEADER || frame.offset > m->length)
+      return false;
+    __sync_synchronize();
+    return *reinterpret_cast<const volatile uint64_t*>(m->base + frame.offset - SHM_SLOT_HEADER) == frame.sequence;
+  }
+
+  const uint8_t * SharedMemoryReader::data (const SharedFrame& frame)
+  {
+    if(!valid(frame))
+      return NULL;
+    const Mapping * m = map(frame.segment);
+    if(frame.offset + frame.size > m->length)
+      return NULL;
+    return m->base + frame.offset;
+  }
+
+  bool SharedMemoryReader::valid (const SharedFrame& frame)
+  {
+    if(matches(map(frame.segment), frame))
+      return true;
+    // a slot reused under us, or a segment replaced since we mapped it,
+    // whose slots never change again
+    return matches(map(frame.segment, true), frame);
+  }
+}
@@ -0,0 +1,95 @@
+/**
+
+\author Michael Ferguson
+
+**/
+
+#include <math.h>
+#include <string.h>
+
+#include "camera_turnpike/triggers.h"
+
+namespace camera_turnpike
+{
+  bool image_signature ( const sensor_msgs::Image& image, std::vector<float>& signature )
+  {
+    if(image.width == 0 || image.height == 0 || image.step < image.width)
+      return false;
+    if(image.data.size() < image.step * image.height)
+      return false;
+
+    // average up to three channels of each sampled pixel
+    unsigned int bpp = image.step / image.width;
+    unsigned int channels = bpp < 3 ? bpp : 3;
+
+    signature.resize(SIGNATURE_COLS * SIGNATURE_ROWS);
+    for(int r = 0; r < SIGNATURE_ROWS; r++)
+    {
+      unsigned int y = (2*r + 1) * image.height / (2*SIGNATURE_ROWS);
+      const unsigned char * row = &image.data[y * image.step];
+      for(int c = 0; c < SIGNATURE_COLS; c++)
+      {
+        unsigned int x = (2*c + 1) * image.width / (2*SIGNATURE_COLS);
+        const unsigned char * px = row + x * bpp;
+        float sum = 0;
+        for(unsigned int k = 0; k < channels; k++)
+          sum += px[k];
+        signature[r * SIGNATURE_COLS + c] = sum / channels;
+      }
+    }
+    return true;
+  }
+
+  double signature_distance ( const std::vector<float>& a, const std::vector<float>& b )
+  {
+    if(a.size() != b.size() || a.empty())
+      return 0.0;
+    double sum = 0;
+    for(size_t i = 0; i < a.size(); i++)
+      sum += fabs(a[i] - b[i]);
+    return sum / a.size();
+  }
+
+  bool cloud_centroid ( const sensor_msgs::PointCloud2& cloud, double centroid[3], int max_samples )
+  {
+    int offset[3] = {-1, -1, -1};
+    const char * axes[] = {"x", "y", "z"};
+    for(size_t f = 0; f < cloud.fields.size(); f++)
+    {
+      for(int i = 0; i < 3; i++)
+      {
+        if(cloud.fields[f].name == axes[i] && cloud.fields[f].datatype == sensor_msgs::PointField::FLOAT32)
+          offset[i] = cloud.fields[f].offset;
+      }
+    }
+    if(offset[0] < 0 || offset[1] < 0 || offset[2] < 0)
+      return false;
+
+    size_t points = cloud.width * cloud.height;
+    if(cloud.data.size() < points * cloud.point_step)
+      return false;
+    size_t stride = points / max_samples;
+    if(stride < 1)
+      stride = 1;
+
+    double sum[3] = {0, 0, 0};
+    int count = 0;
+    for(size_t p = 0; p < points; p += stride)
+    {
+      const unsigned char * pt = &cloud.data[p * cloud.point_step];
+      float v[3];
+      for(int i = 0; i < 3; i++)
+        memcpy(&v[i], pt + offset[i], sizeof(float));
+      if(isnan(v[0]) || isnan(v[1]) || isnan(v[2]))
+        continue;
+      for(int i = 0; i < 3; i++)
+        sum[i] += v[i];
+      count++;
+    }
+    if(count == 0)
+      return false;
+    for(int i = 0; i < 3; i++)
+      centroid[i] = sum[i] / count;
+    return true;
+  }
+}
@@ -0,0 +1,80 @@
+/**
+
+\author Michael Ferguson
+
+@b Round trips of frames through the shared memory hand-off.
+
+**/
+
+#include <gtest/gtest.h>
+
+#include "std_msgs/String.h"
+#include "camera_turnpike/shared_memory.h"
+
+using camera_turnpike::SharedFrame;
+using camera_turnpike::SharedMemoryReader;
+using camera_turnpike::SharedMemoryWriter;
+
+namespace
+{
+  const char SEGMENT[] = "/camera_turnpike_test";
+
+  bool write (SharedMemoryWriter& writer, const std::string& text, SharedFrame& frame)
+  {
+    std_msgs::String msg;
+    msg.data = text;
+    return writer.write(msg, std_msgs::Header(), frame);
+  }
+}
+
+TEST(SharedMemory, RoundTrip)
+{
+  SharedMemoryWriter writer(SEGMENT, 256, 2);
+  ASSERT_TRUE(writer.ok());
+  SharedMemoryReader reader;
+
+  SharedFrame first, second, third;
+  ASSERT_TRUE(write(writer, "first", first));
+  std_msgs::String msg;
+  ASSERT_TRUE(reader.read(first, msg));
+  EXPECT_EQ("first", msg.data);
+
+  // two slots, so the third frame reuses the slot of the first
+  ASSERT_TRUE(write(writer, "second", second));
+  ASSERT_TRUE(write(writer, "third", third));
+  EXPECT_FALSE(reader.valid(first));
+  EXPECT_FALSE(reader.read(first, msg));
+  ASSERT_TRUE(reader.read(second, msg));
+  EXPECT_EQ("second", msg.data);
+  ASSERT_TRUE(reader.read(third, msg));
+  EXPECT_EQ("third", msg.data);
+}
+
+TEST(SharedMemory, WriterRestart)
+{
+  SharedMemoryReader reader;
+  SharedFrame before, after;
+  std_msgs::String msg;
+  {
+    SharedMemoryWriter writer(SEGMENT, 256, 2);
+    ASSERT_TRUE(writer.ok());
+    ASSERT_TRUE(write(writer, "before", before));
+    ASSERT_TRUE(reader.read(before, msg));
+    EXPECT_EQ("before", msg.data);
+  }
+
+  // same name and size, but a new segment the reader has to map again
+  SharedMemoryWriter writer(SEGMENT, 256, 2);
+  ASSERT_TRUE(writer.ok());
+  ASSERT_TRUE(write(writer, "after", after));
+  ASSERT_TRUE(reader.read(after, msg));
+  EXPECT_EQ("after", msg.data);
+  EXPECT_FALSE(reader.valid(before));
+  EXPECT_FALSE(reader.read(before, msg));
+}
+
+int main (int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
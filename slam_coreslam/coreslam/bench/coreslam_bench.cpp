@@ -0,0 +1,180 @@
+/*
+ * slam_coreslam
+ * Microbenchmarks for the hot paths of the node: the map conversion done
+ * by updateMap, filtering ranges, building scans from them, map updates, the distance field and scan matching by
+ * Monte Carlo search and against the distance field. Built and run by
+ * "make bench", see CMakeLists.txt.
+ */
+
+/* Author: Michael Ferguson */
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "albany_util/bench.h"
+#include "albany_util/thread_pool.h"
+#include "../src/map_conversion.h"
+#include "../src/distance_field.h"
+#include "../src/field_matcher.h"
+#include "../src/scan_builder.h"
+#include "../src/scan_filter.h"
+
+#define METERS_TO_MM    1000
+#define MM_TO_METERS    0.001
+
+static const double delta = 0.05;       // default resolution of the node
+static ts_map_t * map;
+static ts_scan_t scan;
+static ts_position_t position;
+static ts_randomizer_t randomizer;
+static std::vector<int8_t> grid(TS_MAP_SIZE * TS_MAP_SIZE);
+static DistanceField field;
+static ts_state_t state;
+static ts_sensor_data_t ranges;
+static ts_scan_t scan2map;
+static ScanBuilder builder;
+static sensor_msgs::LaserScan laser;
+static ScanFilter filter;
+
+/* 360 degree scan from the middle of a 8x8m room, in mm */
+static void buildScan ()
+{
+  const double half = 4.0 * METERS_TO_MM;
+  scan.nb_points = 0;
+  for(int i = 0; i < 360; i++)
+  {
+    double a = i * M_PI / 180.0;
+    double c = cos(a), s = sin(a);
+    double r = std::min(fabs(c) > 1e-6 ? half / fabs(c) : 1e9, fabs(s) > 1e-6 ? half / fabs(s) : 1e9);
+    scan.x[scan.nb_points] = c * r;
+    scan.y[scan.nb_points] = s * r;
+    scan.value[scan.nb_points] = TS_OBSTACLE;
+    scan.nb_points++;
+  }
+}
+
+/* The same room as ranges from a 360 point laser, as the node gets them */
+static void buildRanges ()
+{
+  state.laser_params.offset = 0;
+  state.laser_params.scan_size = 360;
+  state.laser_params.angle_min = 0;
+  state.laser_params.angle_max = 359;
+  state.laser_params.detection_margin = 0;
+  state.laser_params.distance_no_detection = 6000;
+  state.hole_width = 600;
+  for(int i = 0; i < 360; i++)
+    ranges.d[i] = (int) sqrt(scan.x[i] * scan.x[i] + scan.y[i] * scan.y[i]);
+}
+
+/* The room again as a LaserScan, with spikes every few readings */
+static void buildLaser ()
+{
+  laser.angle_min = 0;
+  laser.angle_max = 359 * M_PI / 180;
+  laser.angle_increment = M_PI / 180;
+  laser.range_min = 0.06;
+  laser.range_max = 5.0;
+  laser.ranges.resize(360);
+  for(int i = 0; i < 360; i++)
+    laser.ranges[i] = (i % 17 == 0) ? 0.3 : ranges.d[i] * MM_TO_METERS;
+  filter.configure(0.1, 4.5, 0.17, 5, 0.17);
+}
+
+static void scanFilter ()
+{
+  filter.apply(laser, -0.09);
+}
+
+static void buildScanTwice ()
+{
+  ts_build_scan(&ranges, &scan2map, &state, 3);
+  ts_build_scan(&ranges, &state.scan, &state, 1);
+}
+
+static void buildScanOnce ()
+{
+  builder.build(ranges, state, 3, scan2map, state.scan);
+}
+
+static void conversion ()
+{
+  tsMapToOccupancy(*map, grid, 0, TS_MAP_SIZE);
+}
+
+static void conversionPool (albany_util::ThreadPool * pool)
+{
+  pool->parallelFor(0, TS_MAP_SIZE, boost::bind(&tsMapToOccupancy, boost::cref(*map), boost::ref(grid), _1, _2));
+}
+
+static void mapUpdate ()
+{
+  ts_map_update(&scan, map, &position, 50, 600);
+}
+
+static void distanceField ()
+{
+  int x0, y0, x1, y1;
+  field.markScan(scan, position, 600);
+  field.update(*map, x0, y0, x1, y1);
+}
+
+
+static void distance ()
+{
+  ts_distance_scan_to_map(&scan, map, &position);
+}
+
+static void monteCarlo ()
+{
+  int best;
+  ts_position_t start = position;
+  start.x += 30;
+  start.theta += 2;
+  ts_monte_carlo_search(&randomizer, &scan, map, &start, 100, 20, 1000, &best);
+}
+
+static void fieldMatcher ()
+{
+  ts_position_t start = position;
+  start.x += 30;
+  start.theta += 2;
+  fieldMatch(field, scan, start, 10);
+}
+
+int main (int argc, char ** argv)
+{
+  ts_map_set_scale(MM_TO_METERS / delta);
+  map = new ts_map_t;
+  ts_map_init(map);
+  ts_random_init(&randomizer, 0xdead);
+  buildScan();
+  buildRanges();
+  buildLaser();
+  position.x = position.y = (TS_MAP_SIZE/2) * delta * METERS_TO_MM;
+  position.theta = 0;
+  for(int i = 0; i < 10; i++)
+    mapUpdate();
+  field.init((int) ceil(0.5 / delta));
+  int x0, y0, x1, y1;
+  field.markDirty(0, 0, TS_MAP_SIZE - 1, TS_MAP_SIZE - 1);
+  field.update(*map, x0, y0, x1, y1);
+
+  albany_util::ThreadPool pool(0);
+  albany_util::BenchReport report("coreslam", argc, argv);
+  report.run("update_map_conversion", &conversion);
+  report.run("update_map_conversion_pool", boost::bind(&conversionPool, &pool));
+  report.run("scan_filter", &scanFilter);
+  report.run("ts_build_scan_twice", &buildScanTwice);
+  report.run("scan_builder", &buildScanOnce);
+  report.run("map_update", &mapUpdate);
+  report.run("distance_field_update", &distanceField);
+  report.run("distance_scan_to_map", &distance);
+  report.run("monte_carlo_search", &monteCarlo);
+  report.run("field_match", &fieldMatcher);
+  delete map;
+  return report.write() ? 0 : 1;
+}
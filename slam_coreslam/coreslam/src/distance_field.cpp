@@ -0,0 +1,168 @@
+/*
+ * slam_coreslam
+ * Incremental obstacle distance transform of a CoreSLAM map.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "distance_field.h"
+#include "map_update.h"
+
+#include <math.h>
+#include <algorithm>
+
+DistanceField::DistanceField():
+  max_distance_(0), dirty_x0_(TS_MAP_SIZE), dirty_y0_(TS_MAP_SIZE), dirty_x1_(-1), dirty_y1_(-1)
+{
+}
+
+void DistanceField::init(int max_distance)
+{
+  max_distance_ = std::max(max_distance, 1);
+  // an empty map has no obstacles
+  field_.assign(TS_MAP_SIZE * TS_MAP_SIZE, max_distance_ * DISTANCE_FIELD_SCALE);
+  dirty_x0_ = dirty_y0_ = TS_MAP_SIZE;
+  dirty_x1_ = dirty_y1_ = -1;
+}
+
+void DistanceField::swap(DistanceField& other)
+{
+  std::swap(max_distance_, other.max_distance_);
+  field_.swap(other.field_);
+  std::swap(dirty_x0_, other.dirty_x0_);
+  std::swap(dirty_y0_, other.dirty_y0_);
+  std::swap(dirty_x1_, other.dirty_x1_);
+  std::swap(dirty_y1_, other.dirty_y1_);
+  grid_.swap(other.grid_);
+  f_.swap(other.f_);
+  d_.swap(other.d_);
+  z_.swap(other.z_);
+  v_.swap(other.v_);
+}
+
+void DistanceField::markScan(const ts_scan_t& scan, const ts_position_t& position, int hole_width)
+{
+  int x0, y0, x1, y1;
+  scanBounds(scan, position, hole_width, x0, y0, x1, y1);
+  markDirty(x0, y0, x1, y1);
+}
+
+void DistanceField::markDirty(int x0, int y0, int x1, int y1)
+{
+  dirty_x0_ = std::max(0, std::min(dirty_x0_, x0));
+  dirty_y0_ = std::max(0, std::min(dirty_y0_, y0));
+  dirty_x1_ = std::min(TS_MAP_SIZE - 1, std::max(dirty_x1_, x1));
+  dirty_y1_ = std::min(TS_MAP_SIZE - 1, std::max(dirty_y1_, y1));
+}
+
+bool DistanceField::update(const ts_map_t& map, int& x0, int& y0, int& x1, int& y1)
+{
+  if(!dirty() || field_.empty())
+    return false;
+
+  // cells within max_distance of a change may change, and only
+  // obstacles within max_distance of those cells matter
+  const int m = max_distance_;
+  x0 = std::max(0, dirty_x0_ - m);
+  y0 = std::max(0, dirty_y0_ - m);
+  x1 = std::min(TS_MAP_SIZE - 1, dirty_x1_ + m);
+  y1 = std::min(TS_MAP_SIZE - 1, dirty_y1_ + m);
+  const int wx0 = std::max(0, x0 - m);
+  const int wy0 = std::max(0, y0 - m);
+  const int wx1 = std::min(TS_MAP_SIZE - 1, x1 + m);
+  const int wy1 = std::min(TS_MAP_SIZE - 1, y1 + m);
+  const int w = wx1 - wx0 + 1;
+  const int h = wy1 - wy0 + 1;
+  dirty_x0_ = dirty_y0_ = TS_MAP_SIZE;
+  dirty_x1_ = dirty_y1_ = -1;
+
+  if(grid_.size() < (size_t) (w * h))
+    grid_.resize(w * h);
+  int n = std::max(w, h);
+  if(f_.size() < (size_t) n + 1)
+  {
+    f_.resize(n + 1);
+    d_.resize(n + 1);
+    z_.resize(n + 1);
+    v_.resize(n + 1);
+  }
+
+  // larger than any squared distance in the window, small enough to add to
+  const float inf = 4.0f * ((float) w * w + (float) h * h);
+  for(int y = 0; y < h; y++)
+  {
+    const ts_map_pixel_t * row = &map.map[(wy0 + y) * TS_MAP_SIZE + wx0];
+    float * g = &grid_[y * w];
+    for(int x = 0; x < w; x++)
+      g[x] = (row[x] < (TS_OBSTACLE+TS_NO_OBSTACLE)/2) ? 0.0f : inf;
+  }
+
+  // squared euclidean distance, separably: columns, then rows
+  for(int x = 0; x < w; x++)
+  {
+    for(int y = 0; y < h; y++)
+      f_[y] = grid_[y * w + x];
+    transform1D(h);
+    for(int y = 0; y < h; y++)
+      grid_[y * w + x] = d_[y];
+  }
+
+  const float max_squared = (float) m * m;
+  for(int y = y0; y <= y1; y++)
+  {
+    float * g = &grid_[(y - wy0) * w];
+    for(int x = 0; x < w; x++)
+      f_[x] = g[x];
+    transform1D(w);
+    uint16_t * out = &field_[y * TS_MAP_SIZE];
+    for(int x = x0; x <= x1; x++)
+    {
+      float d = std::min(d_[x - wx0], max_squared);
+      out[x] = (uint16_t) (sqrtf(d) * DISTANCE_FIELD_SCALE + 0.5f);
+    }
+  }
+  return true;
+}
+
+// lower envelope of parabolas, Felzenszwalb and Huttenlocher,
+// "Distance Transforms of Sampled Functions": f_ -> d_
+void DistanceField::transform1D(int n)
+{
+  int k = 0;
+  v_[0] = 0;
+  z_[0] = -1e30f;
+  z_[1] = 1e30f;
+  for(int q = 1; q < n; q++)
+  {
+    float s = ((f_[q] + q * q) - (f_[v_[k]] + v_[k] * v_[k])) / (2 * q - 2 * v_[k]);
+    while(s <= z_[k])
+    {
+      k--;
+      s = ((f_[q] + q * q) - (f_[v_[k]] + v_[k] * v_[k])) / (2 * q - 2 * v_[k]);
+    }
+    k++;
+    v_[k] = q;
+    z_[k] = s;
+    z_[k + 1] = 1e30f;
+  }
+  k = 0;
+  for(int q = 0; q < n; q++)
+  {
+    while(z_[k + 1] < q)
+      k++;
+    d_[q] = (q - v_[k]) * (q - v_[k]) + f_[v_[k]];
+  }
+}
+
+void DistanceField::toOccupancy(std::vector<int8_t>& data, int x0, int x1, int begin, int end) const
+{
+  const int max = max_distance_ * DISTANCE_FIELD_SCALE;
+  for(int y = begin; y < end; y++)
+  {
+    for(int x = x0; x <= x1; x++)
+    {
+      int d = field_[y * TS_MAP_SIZE + x];
+      data[y * TS_MAP_SIZE + x] = (int8_t) (100 - (100 * d + max / 2) / max);
+    }
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * slam_coreslam
+ * Distance from every cell of a CoreSLAM map to the nearest obstacle,
+ * kept up to date incrementally as scans are added.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_DISTANCE_FIELD_H
+#define CORESLAM_DISTANCE_FIELD_H
+
+#include <vector>
+#include <stdint.h>
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+// Distances are stored in 1/DISTANCE_FIELD_SCALE cells
+#define DISTANCE_FIELD_SCALE 16
+
+/*
+ * A map update only changes cells along the rays of one scan, so rather
+ * than transforming the whole 2048x2048 map the field is recomputed in
+ * the bounding box of those rays grown by the maximum distance, from the
+ * obstacles in that box grown once more. Distances beyond the maximum are
+ * clamped to it, which is what makes the window exact.
+ */
+class DistanceField
+{
+  public:
+    DistanceField();
+
+    // Clear the field, max_distance in cells
+    void init(int max_distance);
+    int maxDistance() const { return max_distance_; }
+    // Exchange with a field built elsewhere, without copying
+    void swap(DistanceField& other);
+
+    // Mark cells changed by ts_map_update(scan, map, position, ..., hole_width)
+    void markScan(const ts_scan_t& scan, const ts_position_t& position, int hole_width);
+    // Mark cells [x0,x1]x[y0,y1] changed
+    void markDirty(int x0, int y0, int x1, int y1);
+    bool dirty() const { return dirty_x0_ <= dirty_x1_; }
+
+    // Recompute the field around the marked cells, returns the rectangle
+    // [x0,x1]x[y0,y1] of the field which was rewritten, false if none
+    bool update(const ts_map_t& map, int& x0, int& y0, int& x1, int& y1);
+
+    // Distance of cell (x,y) to the nearest obstacle, in 1/DISTANCE_FIELD_SCALE cells
+    uint16_t at(int x, int y) const { return field_[y * TS_MAP_SIZE + x]; }
+
+    // Convert rows [begin, end) of columns [x0, x1] into occupancy values,
+    // 100 on obstacles falling to 0 at the maximum distance
+    void toOccupancy(std::vector<int8_t>& data, int x0, int x1, int begin, int end) const;
+
+  private:
+    int max_distance_;
+    std::vector<uint16_t> field_;
+
+    int dirty_x0_, dirty_y0_, dirty_x1_, dirty_y1_;
+
+    // scratch for the window transform, grown to the largest window seen
+    std::vector<float> grid_;
+    std::vector<float> f_, d_, z_;
+    std::vector<int> v_;
+
+    void transform1D(int n);
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * slam_coreslam
+ * Gauss-Newton scan matching against the obstacle distance field.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "field_matcher.h"
+
+#include <math.h>
+
+namespace
+{
+  // Bilinear distance and its gradient at (x,y), in cells. CoreSLAM
+  // rounds points to cells, so cell centers are at integer coordinates.
+  inline bool sample(const DistanceField& field, double x, double y, double& d, double& gx, double& gy)
+  {
+    int x0 = (int) floor(x);
+    int y0 = (int) floor(y);
+    if(x0 < 0 || y0 < 0 || x0 >= TS_MAP_SIZE - 1 || y0 >= TS_MAP_SIZE - 1)
+      return false;
+    double fx = x - x0, fy = y - y0;
+    double v00 = field.at(x0, y0), v10 = field.at(x0 + 1, y0);
+    double v01 = field.at(x0, y0 + 1), v11 = field.at(x0 + 1, y0 + 1);
+    const double scale = 1.0 / DISTANCE_FIELD_SCALE;
+    d = ((1 - fy) * ((1 - fx) * v00 + fx * v10) + fy * ((1 - fx) * v01 + fx * v11)) * scale;
+    gx = ((1 - fy) * (v10 - v00) + fy * (v11 - v01)) * scale;
+    gy = ((1 - fx) * (v01 - v00) + fx * (v11 - v10)) * scale;
+    return true;
+  }
+
+  // Sum of squared distances and number of points for a pose in cells and
+  // radians. Points off the map count at the maximum distance, so a step
+  // can't lower the cost by pushing points off it.
+  double sumSquares(const DistanceField& field, const ts_scan_t& scan, double x, double y, double theta, int& n)
+  {
+    double c = cos(theta) * TS_MAP_SCALE, s = sin(theta) * TS_MAP_SCALE;
+    const double off = field.maxDistance();
+    double sum = 0, d, gx, gy;
+    n = 0;
+    for(int i = 0; i < scan.nb_points; i++)
+    {
+      if(scan.value[i] != TS_OBSTACLE)
+        continue;
+      if(!sample(field, x + c * scan.x[i] - s * scan.y[i], y + s * scan.x[i] + c * scan.y[i], d, gx, gy))
+        d = off;
+      sum += d * d;
+      n++;
+    }
+    return sum;
+  }
+
+  // Solve the 3x3 symmetric system a x = b by Cramer's rule
+  bool solve3(const double a[3][3], const double b[3], double x[3])
+  {
+    double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+               - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+               + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    if(fabs(det) < 1e-12)
+      return false;
+    for(int k = 0; k < 3; k++)
+    {
+      double m[3][3];
+      for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+          m[i][j] = (j == k) ? b[i] : a[i][j];
+      x[k] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+            - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+            + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+    }
+    return true;
+  }
+}
+
+ts_position_t fieldMatch(const DistanceField& field, const ts_scan_t& scan,
+                         const ts_position_t& start, int iterations, double* cost)
+{
+  // work in cells and radians
+  double x = start.x * TS_MAP_SCALE;
+  double y = start.y * TS_MAP_SCALE;
+  double theta = start.theta * M_PI / 180;
+  int n;
+  double current = sumSquares(field, scan, x, y, theta, n);
+  double lambda = 1e-3;
+
+  for(int it = 0; it < iterations && n > 0; it++)
+  {
+    double h[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    double g[3] = {0, 0, 0};
+    double c = cos(theta) * TS_MAP_SCALE, s = sin(theta) * TS_MAP_SCALE;
+    for(int i = 0; i < scan.nb_points; i++)
+    {
+      if(scan.value[i] != TS_OBSTACLE)
+        continue;
+      double px = scan.x[i], py = scan.y[i];
+      double d, gx, gy;
+      if(!sample(field, x + c * px - s * py, y + s * px + c * py, d, gx, gy))
+        continue;
+      // derivative of the distance wrt (x, y, theta)
+      double j[3] = { gx, gy, gx * (-s * px - c * py) + gy * (c * px - s * py) };
+      for(int a = 0; a < 3; a++)
+      {
+        g[a] += j[a] * d;
+        for(int b = 0; b < 3; b++)
+          h[a][b] += j[a] * j[b];
+      }
+    }
+
+    // damped step, shrinking the step until the cost decreases
+    bool improved = false;
+    while(!improved && lambda < 1e6)
+    {
+      double hd[3][3], step[3], rhs[3] = { -g[0], -g[1], -g[2] };
+      for(int a = 0; a < 3; a++)
+        for(int b = 0; b < 3; b++)
+          hd[a][b] = h[a][b] + ((a == b) ? lambda * (h[a][a] + 1e-6) : 0.0);
+      if(!solve3(hd, rhs, step))
+        break;
+      // the same points in both sums, so the totals compare
+      int m;
+      double next = sumSquares(field, scan, x + step[0], y + step[1], theta + step[2], m);
+      if(next < current)
+      {
+        x += step[0];
+        y += step[1];
+        theta += step[2];
+        current = next;
+        lambda *= 0.1;
+        improved = true;
+        // converged below a hundredth of a cell and a tenth of a degree
+        if(fabs(step[0]) + fabs(step[1]) < 0.01 && fabs(step[2]) < 0.1 * M_PI / 180)
+          it = iterations;
+      }
+      else
+        lambda *= 10;
+    }
+    if(!improved)
+      break;
+  }
+
+  if(cost)
+    *cost = n ? sqrt(current / n) : field.maxDistance();
+
+  ts_position_t position;
+  position.x = x / TS_MAP_SCALE;
+  position.y = y / TS_MAP_SCALE;
+  position.theta = theta * 180 / M_PI;
+  return position;
+}
+
+double fieldCost(const DistanceField& field, const ts_scan_t& scan, const ts_position_t& position)
+{
+  int n;
+  double sum = sumSquares(field, scan, position.x * TS_MAP_SCALE, position.y * TS_MAP_SCALE,
+                          position.theta * M_PI / 180, n);
+  return n ? sqrt(sum / n) : field.maxDistance();
+}
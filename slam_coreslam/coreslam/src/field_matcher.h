@@ -0,0 +1,33 @@
+/*
+ * slam_coreslam
+ * Scan matching against the obstacle distance field, an alternative to
+ * the Monte Carlo search of ts_iterative_map_building.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_FIELD_MATCHER_H
+#define CORESLAM_FIELD_MATCHER_H
+
+#include "distance_field.h"
+
+/*
+ * Refine start by Gauss-Newton (Levenberg-Marquardt damped) steps which
+ * minimize the squared distance field under the obstacle points of scan.
+ * The field is smooth where the hole-profile map is a plateau, so a few
+ * steps do what takes the Monte Carlo search a thousand samples. Points
+ * at or beyond the maximum distance give no gradient, which makes the
+ * match robust to new and moving obstacles but limits its capture range
+ * to about the maximum distance.
+ *
+ * Positions are CoreSLAM's: mm and degrees. If cost is given it is set
+ * to the root mean square distance, in cells, of the scan points at the
+ * result.
+ */
+ts_position_t fieldMatch(const DistanceField& field, const ts_scan_t& scan,
+                         const ts_position_t& start, int iterations, double* cost = 0);
+
+// Root mean square distance, in cells, of the obstacle points of scan placed at position
+double fieldCost(const DistanceField& field, const ts_scan_t& scan, const ts_position_t& position);
+
+#endif
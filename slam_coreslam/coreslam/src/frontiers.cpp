@@ -0,0 +1,157 @@
+/*
+ * slam_coreslam
+ * Incremental frontier extraction, see frontiers.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "frontiers.h"
+#include "map_update.h"
+
+#include <algorithm>
+
+namespace
+{
+  const int UNKNOWN = (TS_OBSTACLE+TS_NO_OBSTACLE)/2;
+  const int TILES = TS_MAP_SIZE / FRONTIER_TILE;
+
+  // flags_ values
+  const uint8_t FRONTIER = 1;
+  const uint8_t VISITED = 2;
+}
+
+FrontierFinder::FrontierFinder():
+  dirty_x0_(TS_MAP_SIZE), dirty_y0_(TS_MAP_SIZE), dirty_x1_(-1), dirty_y1_(-1)
+{
+}
+
+void FrontierFinder::init()
+{
+  flags_.assign(TS_MAP_SIZE * TS_MAP_SIZE, 0);
+  tiles_.assign(TILES * TILES, 0);
+  segments_.clear();
+  dirty_x0_ = dirty_y0_ = TS_MAP_SIZE;
+  dirty_x1_ = dirty_y1_ = -1;
+}
+
+void FrontierFinder::swap(FrontierFinder& other)
+{
+  flags_.swap(other.flags_);
+  tiles_.swap(other.tiles_);
+  segments_.swap(other.segments_);
+  std::swap(dirty_x0_, other.dirty_x0_);
+  std::swap(dirty_y0_, other.dirty_y0_);
+  std::swap(dirty_x1_, other.dirty_x1_);
+  std::swap(dirty_y1_, other.dirty_y1_);
+  stack_.swap(other.stack_);
+}
+
+void FrontierFinder::markScan(const ts_scan_t& scan, const ts_position_t& position, int hole_width)
+{
+  int x0, y0, x1, y1;
+  scanBounds(scan, position, hole_width, x0, y0, x1, y1);
+  markDirty(x0, y0, x1, y1);
+}
+
+void FrontierFinder::markDirty(int x0, int y0, int x1, int y1)
+{
+  dirty_x0_ = std::max(0, std::min(dirty_x0_, x0));
+  dirty_y0_ = std::max(0, std::min(dirty_y0_, y0));
+  dirty_x1_ = std::min(TS_MAP_SIZE - 1, std::max(dirty_x1_, x1));
+  dirty_y1_ = std::min(TS_MAP_SIZE - 1, std::max(dirty_y1_, y1));
+}
+
+bool FrontierFinder::update(const ts_map_t& map, int min_size)
+{
+  if(!dirty() || flags_.empty())
+    return false;
+
+  // a cell's flag depends on its 4 neighbours, the map's border is never
+  // a frontier so neighbours need no bounds checks
+  const int x0 = std::max(1, dirty_x0_ - 1), x1 = std::min(TS_MAP_SIZE - 2, dirty_x1_ + 1);
+  const int y0 = std::max(1, dirty_y0_ - 1), y1 = std::min(TS_MAP_SIZE - 2, dirty_y1_ + 1);
+  const ts_map_pixel_t* m = map.map;
+  for(int y = y0; y <= y1; y++)
+  {
+    int* tile = &tiles_[(y / FRONTIER_TILE) * TILES];
+    for(int x = x0; x <= x1; x++)
+    {
+      int i = y * TS_MAP_SIZE + x;
+      uint8_t f = (m[i] > UNKNOWN &&
+                   (m[i - 1] == UNKNOWN || m[i + 1] == UNKNOWN ||
+                    m[i - TS_MAP_SIZE] == UNKNOWN || m[i + TS_MAP_SIZE] == UNKNOWN)) ? FRONTIER : 0;
+      if(f != flags_[i])
+      {
+        tile[x / FRONTIER_TILE] += f ? 1 : -1;
+        flags_[i] = f;
+      }
+    }
+  }
+  dirty_x0_ = dirty_y0_ = TS_MAP_SIZE;
+  dirty_x1_ = dirty_y1_ = -1;
+
+  // flood fill the frontier from the tiles which have some
+  segments_.clear();
+  for(int t = 0; t < TILES * TILES; t++)
+  {
+    if(tiles_[t] == 0)
+      continue;
+    const int tx = (t % TILES) * FRONTIER_TILE, ty = (t / TILES) * FRONTIER_TILE;
+    for(int y = ty; y < ty + FRONTIER_TILE; y++)
+    {
+      for(int x = tx; x < tx + FRONTIER_TILE; x++)
+      {
+        if(flags_[y * TS_MAP_SIZE + x] != FRONTIER)
+          continue;
+        Segment s;
+        s.x = s.y = 0;
+        s.x0 = s.x1 = x;
+        s.y0 = s.y1 = y;
+        s.size = 0;
+        flags_[y * TS_MAP_SIZE + x] |= VISITED;
+        stack_.push_back(y * TS_MAP_SIZE + x);
+        while(!stack_.empty())
+        {
+          int i = stack_.back();
+          stack_.pop_back();
+          int cx = i % TS_MAP_SIZE, cy = i / TS_MAP_SIZE;
+          s.x += cx;
+          s.y += cy;
+          s.x0 = std::min(s.x0, cx);
+          s.x1 = std::max(s.x1, cx);
+          s.y0 = std::min(s.y0, cy);
+          s.y1 = std::max(s.y1, cy);
+          s.size++;
+          for(int dy = -1; dy <= 1; dy++)
+          {
+            for(int dx = -1; dx <= 1; dx++)
+            {
+              int j = i + dy * TS_MAP_SIZE + dx;
+              if(flags_[j] == FRONTIER)
+              {
+                flags_[j] |= VISITED;
+                stack_.push_back(j);
+              }
+            }
+          }
+        }
+        s.x /= s.size;
+        s.y /= s.size;
+        if(s.size >= min_size)
+          segments_.push_back(s);
+      }
+    }
+  }
+
+  // clear the visited marks, again only in tiles with frontiers
+  for(int t = 0; t < TILES * TILES; t++)
+  {
+    if(tiles_[t] == 0)
+      continue;
+    const int tx = (t % TILES) * FRONTIER_TILE, ty = (t / TILES) * FRONTIER_TILE;
+    for(int y = ty; y < ty + FRONTIER_TILE; y++)
+      for(int x = tx; x < tx + FRONTIER_TILE; x++)
+        flags_[y * TS_MAP_SIZE + x] &= FRONTIER;
+  }
+  return true;
+}
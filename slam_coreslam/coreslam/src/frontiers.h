@@ -0,0 +1,68 @@
+/*
+ * slam_coreslam
+ * Frontiers of a CoreSLAM map, the free cells bordering unknown ones,
+ * kept up to date incrementally as scans are added.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_FRONTIERS_H
+#define CORESLAM_FRONTIERS_H
+
+#include <vector>
+#include <stdint.h>
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+// Side of the tiles frontier cells are counted in
+#define FRONTIER_TILE 64
+
+/*
+ * A flag per cell says whether it is a frontier; flags are recomputed
+ * only around the cells marked changed since the last update, and
+ * each tile keeps a count of its frontier cells. Clustering then only
+ * visits the tiles with frontiers in them, so an update costs the
+ * changed area plus the frontier, not the whole map.
+ */
+class FrontierFinder
+{
+  public:
+    // 8-connected frontier cells, in cells of the map
+    struct Segment
+    {
+      double x, y;            // centroid
+      int x0, y0, x1, y1;     // bounding box
+      int size;               // cells
+    };
+
+    FrontierFinder();
+
+    // Clear the frontier, for an empty map
+    void init();
+    // Exchange with a finder built elsewhere, without copying
+    void swap(FrontierFinder& other);
+
+    // Mark cells changed by ts_map_update(scan, map, position, ..., hole_width)
+    void markScan(const ts_scan_t& scan, const ts_position_t& position, int hole_width);
+    // Mark cells [x0,x1]x[y0,y1] changed
+    void markDirty(int x0, int y0, int x1, int y1);
+    bool dirty() const { return dirty_x0_ <= dirty_x1_; }
+
+    // Recompute the flags around the marked cells and cluster the frontier
+    // into segments of at least min_size cells, false if nothing changed
+    bool update(const ts_map_t& map, int min_size);
+    const std::vector<Segment>& segments() const { return segments_; }
+
+  private:
+    std::vector<uint8_t> flags_;
+    std::vector<int> tiles_;        // frontier cells per tile
+    std::vector<Segment> segments_;
+
+    int dirty_x0_, dirty_y0_, dirty_x1_, dirty_y1_;
+
+    std::vector<int> stack_;        // scratch for the clustering
+};
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * slam_coreslam
+ * Conversion of CoreSLAM maps to ROS occupancy grids.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "map_conversion.h"
+
+// compute linear index for given map coords
+#define MAP_IDX(sx, i, j) ((sx) * (j) + (i))
+
+void tsMapToOccupancy(const ts_map_t& map, std::vector<int8_t>& data, int begin, int end)
+{
+  for(int y=begin; y < end; y++)
+  {
+    for(int x=0; x < TS_MAP_SIZE; x++)
+    {
+      int occ= (int)(map.map[ y * TS_MAP_SIZE + x]);
+      if(occ == (TS_OBSTACLE+TS_NO_OBSTACLE)/2 )
+        data[MAP_IDX(TS_MAP_SIZE, x, y)] = -1;
+      else if(occ < (TS_OBSTACLE+TS_NO_OBSTACLE)/2 )
+        data[MAP_IDX(TS_MAP_SIZE, x, y)] = 100;
+      else
+        data[MAP_IDX(TS_MAP_SIZE, x, y)] = 0;
+    }
+  }
+}
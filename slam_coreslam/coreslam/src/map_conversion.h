@@ -0,0 +1,23 @@
+/*
+ * slam_coreslam
+ * Conversion of CoreSLAM maps to ROS occupancy grids, shared by the node
+ * and the benchmarks.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_MAP_CONVERSION_H
+#define CORESLAM_MAP_CONVERSION_H
+
+#include <vector>
+#include <stdint.h>
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+// Convert rows [begin, end) of a CoreSLAM map into occupancy values
+// (-1 unknown, 0 free, 100 occupied) of a TS_MAP_SIZE wide grid
+void tsMapToOccupancy(const ts_map_t& map, std::vector<int8_t>& data, int begin, int end);
+
+#endif
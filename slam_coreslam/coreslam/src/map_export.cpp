@@ -0,0 +1,75 @@
+/*
+ * slam_coreslam
+ * Saving occupancy grids in the format of map_server, see map_export.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "map_export.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+bool saveMap(const std::string& name, const std::vector<int8_t>& data, int width, int height,
+             double resolution, double origin_x, double origin_y, double origin_yaw)
+{
+  // bounds of the known cells, or the whole grid if there are none
+  int x0 = width, y0 = height, x1 = -1, y1 = -1;
+  for(int y = 0; y < height; y++)
+  {
+    const int8_t* row = &data[y * width];
+    int first = 0;
+    while(first < width && row[first] == -1)
+      first++;
+    if(first == width)
+      continue;
+    int last = width - 1;
+    while(row[last] == -1)
+      last--;
+    x0 = std::min(x0, first);
+    x1 = std::max(x1, last);
+    y0 = std::min(y0, y);
+    y1 = y;
+  }
+  if(x1 < 0)
+  {
+    x0 = y0 = 0;
+    x1 = width - 1;
+    y1 = height - 1;
+  }
+  const int w = x1 - x0 + 1, h = y1 - y0 + 1;
+
+  std::string pgm = name + ".pgm";
+  FILE* out = fopen(pgm.c_str(), "w");
+  if(!out)
+    return false;
+  fprintf(out, "P5\n# CREATOR: slam_coreslam %.3f m/pix\n%d %d\n255\n", resolution, w, h);
+  // top row first
+  std::vector<unsigned char> line(w);
+  for(int y = y1; y >= y0; y--)
+  {
+    const int8_t* row = &data[y * width + x0];
+    for(int x = 0; x < w; x++)
+      line[x] = (row[x] == 0) ? 254 : (row[x] == 100) ? 0 : 205;
+    fwrite(&line[0], 1, w, out);
+  }
+  bool ok = !ferror(out);
+  ok = (fclose(out) == 0) && ok;
+  if(!ok)
+    return false;
+
+  // the crop moves the origin along the grid's axes
+  double c = cos(origin_yaw), s = sin(origin_yaw);
+  double x = origin_x + (c * x0 - s * y0) * resolution;
+  double y = origin_y + (s * x0 + c * y0) * resolution;
+  std::string image = pgm.substr(pgm.find_last_of('/') + 1);
+  std::string yaml = name + ".yaml";
+  out = fopen(yaml.c_str(), "w");
+  if(!out)
+    return false;
+  fprintf(out, "image: %s\nresolution: %f\norigin: [%f, %f, %f]\nnegate: 0\noccupied_thresh: 0.65\nfree_thresh: 0.196\n\n",
+          image.c_str(), resolution, x, y, origin_yaw);
+  ok = !ferror(out);
+  return (fclose(out) == 0) && ok;
+}
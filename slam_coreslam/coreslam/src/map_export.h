@@ -0,0 +1,21 @@
+/*
+ * slam_coreslam
+ * Saving occupancy grids in the format of map_server.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_MAP_EXPORT_H
+#define CORESLAM_MAP_EXPORT_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Write name.pgm and name.yaml as map_saver does (254 free, 0 occupied,
+// 205 unknown, thresholds 0.65 and 0.196), cropped to the known cells.
+// origin is the map frame pose of cell (0,0). Returns false on failure.
+bool saveMap(const std::string& name, const std::vector<int8_t>& data, int width, int height,
+             double resolution, double origin_x, double origin_y, double origin_yaw);
+
+#endif
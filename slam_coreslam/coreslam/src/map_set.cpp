@@ -0,0 +1,141 @@
+/*
+ * slam_coreslam
+ * Named CoreSLAM maps kept in memory mapped files, see map_set.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "map_set.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ros/ros.h"
+
+MapSet::MapSet()
+{
+}
+
+MapSet::~MapSet()
+{
+  for(std::map<std::string, ts_map_t*>::iterator it = maps_.begin(); it != maps_.end(); it++)
+    munmap(it->second, sizeof(ts_map_t));
+}
+
+bool MapSet::open(const std::string& directory)
+{
+  if(mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    ROS_ERROR("Cannot create map set directory %s: %s", directory.c_str(), strerror(errno));
+    return false;
+  }
+  directory_ = directory;
+  return true;
+}
+
+// map a file already of the size of a ts_map_t
+static ts_map_t* mapFile(int fd, const std::string& path)
+{
+  void* data = mmap(NULL, sizeof(ts_map_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(data == MAP_FAILED)
+  {
+    ROS_ERROR("Cannot map %s: %s", path.c_str(), strerror(errno));
+    return NULL;
+  }
+  return (ts_map_t*) data;
+}
+
+// A new map is sized and initialized under a temporary name and only
+// then renamed into place, so a crash never leaves a map of zeros, which
+// would read as all obstacles
+static ts_map_t* createMap(const std::string& path)
+{
+  std::string tmp = path + ".tmp";
+  int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+  {
+    ROS_ERROR("Cannot create map %s: %s", tmp.c_str(), strerror(errno));
+    return NULL;
+  }
+  if(ftruncate(fd, sizeof(ts_map_t)) < 0)
+  {
+    ROS_ERROR("Cannot size map %s: %s", tmp.c_str(), strerror(errno));
+    close(fd);
+    unlink(tmp.c_str());
+    return NULL;
+  }
+  ts_map_t* map = mapFile(fd, tmp);
+  close(fd);
+  if(map == NULL)
+  {
+    unlink(tmp.c_str());
+    return NULL;
+  }
+  ts_map_init(map);
+  if(msync(map, sizeof(ts_map_t), MS_SYNC) < 0 || rename(tmp.c_str(), path.c_str()) < 0)
+  {
+    ROS_ERROR("Cannot write map %s: %s", path.c_str(), strerror(errno));
+    munmap(map, sizeof(ts_map_t));
+    unlink(tmp.c_str());
+    return NULL;
+  }
+  return map;
+}
+
+ts_map_t* MapSet::map(const std::string& name, bool& created)
+{
+  created = false;
+  std::map<std::string, ts_map_t*>::iterator it = maps_.find(name);
+  if(it != maps_.end())
+    return it->second;
+
+  if(name.empty() || name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != std::string::npos)
+  {
+    ROS_ERROR("Invalid map name '%s'", name.c_str());
+    return NULL;
+  }
+  std::string path = directory_ + "/" + name + ".map";
+  int fd = ::open(path.c_str(), O_RDWR);
+  if(fd < 0 && errno != ENOENT)
+  {
+    ROS_ERROR("Cannot open map %s: %s", path.c_str(), strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  if(fd >= 0 && (fstat(fd, &st) < 0 || st.st_size != (off_t) sizeof(ts_map_t)))
+  {
+    // not a map of this TS_MAP_SIZE, or not a map at all: leave it be
+    ROS_ERROR("Map %s has the wrong size for TS_MAP_SIZE %d, not using it", path.c_str(), TS_MAP_SIZE);
+    close(fd);
+    return NULL;
+  }
+
+  ts_map_t* map;
+  if(fd >= 0)
+  {
+    map = mapFile(fd, path);
+    close(fd);
+    // start reading it in ahead of the matcher
+    if(map)
+      madvise(map, sizeof(ts_map_t), MADV_WILLNEED);
+  }
+  else
+  {
+    map = createMap(path);
+    created = (map != NULL);
+  }
+  if(map == NULL)
+    return NULL;
+  maps_[name] = map;
+  ROS_INFO("Opened map %s", path.c_str());
+  return map;
+}
+
+void MapSet::flush(ts_map_t* map)
+{
+  msync(map, sizeof(ts_map_t), MS_ASYNC);
+}
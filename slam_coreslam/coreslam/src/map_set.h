@@ -0,0 +1,47 @@
+/*
+ * slam_coreslam
+ * Named CoreSLAM maps kept in memory mapped files.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_MAP_SET_H
+#define CORESLAM_MAP_SET_H
+
+#include <map>
+#include <string>
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+/*
+ * Each map of the set is a file <directory>/<name>.map holding the cells
+ * of a ts_map_t as they are in memory, mapped shared, so the map is
+ * saved as CoreSLAM writes to it and a map switched to is usable as soon
+ * as it is mapped: its pages come in from the page cache as the matcher
+ * touches them. Maps stay mapped once opened, switching back is free.
+ */
+class MapSet
+{
+  public:
+    MapSet();
+    ~MapSet();
+
+    // Use directory for the maps, creating it if need be
+    bool open(const std::string& directory);
+
+    // The map called name, mapped and, if it is new, initialized. Names
+    // are letters, digits, '_' and '-'. Returns NULL on failure, and for
+    // a file of the wrong size, which is left as it is.
+    ts_map_t* map(const std::string& name, bool& created);
+
+    // Schedule a write back of the changes made to a map
+    void flush(ts_map_t* map);
+
+  private:
+    std::string directory_;
+    std::map<std::string, ts_map_t*> maps_;
+};
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * slam_coreslam
+ * Extent of a map update, see map_update.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "map_update.h"
+
+#include <math.h>
+#include <algorithm>
+
+void scanBounds(const ts_scan_t& scan, const ts_position_t& position, int hole_width,
+                int& x0, int& y0, int& x1, int& y1)
+{
+  // same transform as ts_map_update, rays run from the robot to just past each point
+  double c = cos(position.theta * M_PI / 180);
+  double s = sin(position.theta * M_PI / 180);
+  double min_x = position.x, max_x = position.x;
+  double min_y = position.y, max_y = position.y;
+  for(int i = 0; i < scan.nb_points; i++)
+  {
+    double x = position.x + c * scan.x[i] - s * scan.y[i];
+    double y = position.y + s * scan.x[i] + c * scan.y[i];
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+  }
+  x0 = (int) floor((min_x - hole_width) * TS_MAP_SCALE) - 1;
+  y0 = (int) floor((min_y - hole_width) * TS_MAP_SCALE) - 1;
+  x1 = (int) ceil((max_x + hole_width) * TS_MAP_SCALE) + 1;
+  y1 = (int) ceil((max_y + hole_width) * TS_MAP_SCALE) + 1;
+}
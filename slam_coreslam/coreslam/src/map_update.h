@@ -0,0 +1,20 @@
+/*
+ * slam_coreslam
+ * Extent of the cells a ts_map_update call can change.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_MAP_UPDATE_H
+#define CORESLAM_MAP_UPDATE_H
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+// Bounding box [x0,x1]x[y0,y1] of the cells that updating a map with
+// scan from position can change, unclipped
+void scanBounds(const ts_scan_t& scan, const ts_position_t& position, int hole_width,
+                int& x0, int& y0, int& x1, int& y1);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * slam_coreslam
+ * Pose graph relaxation, see pose_graph.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "pose_graph.h"
+
+#include <math.h>
+#include <algorithm>
+
+double normalizeAngle(double a)
+{
+  return atan2(sin(a), cos(a));
+}
+
+Pose2D Pose2D::operator*(const Pose2D& b) const
+{
+  double c = cos(theta), s = sin(theta);
+  return Pose2D(x + c * b.x - s * b.y, y + s * b.x + c * b.y, normalizeAngle(theta + b.theta));
+}
+
+Pose2D Pose2D::inverse() const
+{
+  double c = cos(theta), s = sin(theta);
+  return Pose2D(-c * x - s * y, s * x - c * y, -theta);
+}
+
+void Pose2D::transform(double px, double py, double& x_out, double& y_out) const
+{
+  double c = cos(theta), s = sin(theta);
+  x_out = x + c * px - s * py;
+  y_out = y + s * px + c * py;
+}
+
+Pose2D between(const Pose2D& a, const Pose2D& b)
+{
+  return a.inverse() * b;
+}
+
+int PoseGraph::addNode(const Pose2D& pose)
+{
+  nodes_.push_back(pose);
+  adjacent_.push_back(std::vector<int>());
+  return nodes_.size() - 1;
+}
+
+void PoseGraph::addEdge(int from, int to, const Pose2D& measurement, double weight)
+{
+  Edge e;
+  e.from = from;
+  e.to = to;
+  e.measurement = measurement;
+  e.weight = weight;
+  edges_.push_back(e);
+  adjacent_[from].push_back(edges_.size() - 1);
+  adjacent_[to].push_back(edges_.size() - 1);
+}
+
+bool PoseGraph::optimize(int sweeps, double tolerance)
+{
+  double last = 0;
+  for(int sweep = 0; sweep < sweeps; sweep++)
+  {
+    double moved = 0;
+    for(size_t i = 1; i < nodes_.size(); i++)
+    {
+      // weighted mean of the poses predicted by the neighbours
+      double x = 0, y = 0, c = 0, s = 0, w = 0;
+      for(size_t k = 0; k < adjacent_[i].size(); k++)
+      {
+        const Edge& e = edges_[adjacent_[i][k]];
+        Pose2D p = (e.to == (int) i) ? nodes_[e.from] * e.measurement
+                                     : nodes_[e.to] * e.measurement.inverse();
+        x += e.weight * p.x;
+        y += e.weight * p.y;
+        c += e.weight * cos(p.theta);
+        s += e.weight * sin(p.theta);
+        w += e.weight;
+      }
+      if(w <= 0)
+        continue;
+      Pose2D p(x / w, y / w, atan2(s, c));
+      moved = std::max(moved, std::max(fabs(p.x - nodes_[i].x), fabs(p.y - nodes_[i].y)));
+      moved = std::max(moved, fabs(normalizeAngle(p.theta - nodes_[i].theta)));
+      nodes_[i] = p;
+    }
+    if(moved == 0)
+      return true;
+    // Long loops creep: each sweep moves the nodes by a ratio r of the
+    // last, leaving about moved * r / (1 - r) to go, which can be far
+    // more than one small sweep suggests
+    double r = (last > 0) ? moved / last : 1;
+    if(moved < tolerance && r < 1 && moved * r / (1 - r) < tolerance)
+      return true;
+    last = moved;
+  }
+  return false;
+}
@@ -0,0 +1,71 @@
+/*
+ * slam_coreslam
+ * A sparse graph of planar poses linked by relative pose constraints.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_POSE_GRAPH_H
+#define CORESLAM_POSE_GRAPH_H
+
+#include <vector>
+
+// Planar pose, meters and radians
+struct Pose2D
+{
+  double x, y, theta;
+
+  Pose2D() : x(0), y(0), theta(0) {}
+  Pose2D(double x, double y, double theta) : x(x), y(y), theta(theta) {}
+
+  // this then b, b given in the frame of this
+  Pose2D operator*(const Pose2D& b) const;
+  Pose2D inverse() const;
+  // the point (px,py) of this frame in the parent frame
+  void transform(double px, double py, double& x_out, double& y_out) const;
+};
+
+// b relative to a: a.inverse() * b
+Pose2D between(const Pose2D& a, const Pose2D& b);
+
+double normalizeAngle(double a);
+
+/*
+ * Nodes are poses in the world, edges measure the pose of one node in
+ * the frame of another. optimize() moves the nodes to agree with the
+ * edges, node 0 staying fixed, by Gauss-Seidel relaxation: each node in
+ * turn goes to the weighted mean of the poses its edges predict for it
+ * (Duckett, Marsland and Shapiro, "Fast, On-Line Learning of Globally
+ * Consistent Maps"). A sweep is linear in the edges, so it can run on a
+ * thread while the nodes are copied out and in.
+ */
+class PoseGraph
+{
+  public:
+    struct Edge
+    {
+      int from, to;
+      Pose2D measurement;   // pose of "to" in the frame of "from"
+      double weight;
+    };
+
+    int addNode(const Pose2D& pose);
+    void addEdge(int from, int to, const Pose2D& measurement, double weight);
+
+    int size() const { return nodes_.size(); }
+    const Pose2D& node(int i) const { return nodes_[i]; }
+    void setNode(int i, const Pose2D& pose) { nodes_[i] = pose; }
+    const std::vector<Edge>& edges() const { return edges_; }
+
+    // Relax for up to sweeps sweeps, returns true once the nodes are
+    // within about tolerance (meters or radians) of where they settle
+    bool optimize(int sweeps, double tolerance);
+
+  private:
+    std::vector<Pose2D> nodes_;
+    std::vector<Edge> edges_;
+    // edges touching each node
+    std::vector<std::vector<int> > adjacent_;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * slam_coreslam
+ * Single pass scan building from trig tables.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "scan_builder.h"
+
+#include <math.h>
+#include <algorithm>
+
+ScanBuilder::ScanBuilder():
+  scan_size_(0), span_(0), angle_min_(0), angle_max_(0)
+{
+}
+
+void ScanBuilder::setup(const ts_laser_parameters_t& params, int span)
+{
+  if(params.scan_size == scan_size_ && span == span_ &&
+     params.angle_min == angle_min_ && params.angle_max == angle_max_)
+    return;
+  scan_size_ = params.scan_size;
+  span_ = span;
+  angle_min_ = params.angle_min;
+  angle_max_ = params.angle_max;
+
+  // the angles of ts_build_scan, spread over scan_size * span - 1 steps
+  // (a single reading is at angle_min)
+  const int map_steps = std::max(1, scan_size_ * span_ - 1);
+  const int match_steps = std::max(1, scan_size_ - 1);
+  map_cos_.resize(scan_size_ * span_);
+  map_sin_.resize(scan_size_ * span_);
+  for(int k = 0; k < scan_size_ * span_; k++)
+  {
+    double angle_deg = angle_min_ + ((double) k) * (angle_max_ - angle_min_) / map_steps;
+    map_cos_[k] = cos(angle_deg * M_PI / 180);
+    map_sin_[k] = sin(angle_deg * M_PI / 180);
+  }
+  match_cos_.resize(scan_size_);
+  match_sin_.resize(scan_size_);
+  for(int k = 0; k < scan_size_; k++)
+  {
+    double angle_deg = angle_min_ + ((double) k) * (angle_max_ - angle_min_) / match_steps;
+    match_cos_[k] = cos(angle_deg * M_PI / 180);
+    match_sin_[k] = sin(angle_deg * M_PI / 180);
+  }
+}
+
+void ScanBuilder::build(const ts_sensor_data_t& sd, const ts_state_t& state, int span,
+                        ts_scan_t& map_scan, ts_scan_t& match_scan)
+{
+  setup(state.laser_params, span);
+  map_scan.nb_points = 0;
+  match_scan.nb_points = 0;
+
+  // ranges outside the margins, or shorter than the hole or beyond the
+  // laser's reach, give no points
+  const int first = state.laser_params.detection_margin + 1;
+  const int last = scan_size_ - state.laser_params.detection_margin;
+  const double no_detection = state.laser_params.distance_no_detection;
+  for(int i = first; i < last; i++)
+  {
+    const int d = sd.d[i];
+    if(d <= state.hole_width || d >= no_detection)
+      continue;
+
+    int n = map_scan.nb_points;
+    for(int j = 0, k = i * span_; j < span_; j++, k++, n++)
+    {
+      map_scan.x[n] = d * map_cos_[k];
+      map_scan.y[n] = d * map_sin_[k];
+      map_scan.value[n] = TS_OBSTACLE;
+    }
+    map_scan.nb_points = n;
+
+    n = match_scan.nb_points;
+    match_scan.x[n] = d * match_cos_[i];
+    match_scan.y[n] = d * match_sin_[i];
+    match_scan.value[n] = TS_OBSTACLE;
+    match_scan.nb_points = n + 1;
+  }
+}
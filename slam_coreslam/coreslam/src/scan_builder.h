@@ -0,0 +1,49 @@
+/*
+ * slam_coreslam
+ * Single pass scan building for the distance field matcher.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_SCAN_BUILDER_H
+#define CORESLAM_SCAN_BUILDER_H
+
+#include <vector>
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+
+/*
+ * ts_build_scan recomputes the angle, cosine and sine of every point on
+ * each call, and ts_iterative_map_building calls it twice per scan. The
+ * field matcher builds its scans here instead: the cosines and sines are
+ * kept in tables, rebuilt only when the laser parameters change, and
+ * each range is tested once for both scans. The Monte Carlo matcher
+ * still goes through CoreSLAM's own ts_iterative_map_building.
+ */
+class ScanBuilder
+{
+  public:
+    ScanBuilder();
+
+    // The points of ts_build_scan(&sd, &map_scan, &state, span) and
+    // ts_build_scan(&sd, &match_scan, &state, 1), following its angles
+    // and range tests
+    void build(const ts_sensor_data_t& sd, const ts_state_t& state, int span,
+               ts_scan_t& map_scan, ts_scan_t& match_scan);
+
+  private:
+    int scan_size_;
+    int span_;
+    double angle_min_;
+    double angle_max_;
+
+    // cos and sin of each point of the map scan, then of the match scan
+    std::vector<double> map_cos_, map_sin_;
+    std::vector<double> match_cos_, match_sin_;
+
+    void setup(const ts_laser_parameters_t& params, int span);
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * slam_coreslam
+ * Laser pre-filters, see scan_filter.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "scan_filter.h"
+
+#include <math.h>
+#include <algorithm>
+
+ScanFilter::ScanFilter():
+  min_range_(0), max_range_(0), footprint_radius_(0), median_window_(0), shadow_angle_(0),
+  enabled_(false), angle_min_(0), angle_increment_(0), range_min_(0), offset_(0)
+{
+}
+
+void ScanFilter::init(const ros::NodeHandle& nh)
+{
+  double min_range, max_range, footprint_radius, shadow_angle;
+  int median_window;
+  nh.param("min_range", min_range, 0.0);
+  nh.param("max_range", max_range, 0.0);
+  nh.param("footprint_radius", footprint_radius, 0.0);
+  nh.param("median_window", median_window, 0);
+  nh.param("shadow_angle", shadow_angle, 0.0);
+  if(median_window != 0 && median_window != 3 && median_window != 5)
+  {
+    ROS_WARN("Median window of %d readings not supported, using 3", median_window);
+    median_window = 3;
+  }
+  configure(min_range, max_range, footprint_radius, median_window, shadow_angle);
+}
+
+void ScanFilter::configure(double min_range, double max_range, double footprint_radius,
+                           int median_window, double shadow_angle)
+{
+  min_range_ = min_range;
+  max_range_ = max_range;
+  footprint_radius_ = footprint_radius;
+  median_window_ = median_window;
+  shadow_angle_ = shadow_angle;
+  enabled_ = min_range_ > 0 || max_range_ > 0 || footprint_radius_ > 0 || median_window_ > 1 || shadow_angle_ > 0;
+  min_.clear();
+}
+
+const std::vector<float>& ScanFilter::apply(const sensor_msgs::LaserScan& scan, double laser_offset)
+{
+  if(!enabled_)
+    return scan.ranges;
+
+  const int n = scan.ranges.size();
+  if((int) min_.size() != n || angle_min_ != scan.angle_min || angle_increment_ != scan.angle_increment ||
+     range_min_ != scan.range_min || offset_ != laser_offset)
+  {
+    // distance along each beam at which it leaves the footprint, a circle
+    // about the base: r^2 + 2 d r cos(a) + d^2 - R^2 = 0
+    min_.resize(n);
+    angle_min_ = scan.angle_min;
+    angle_increment_ = scan.angle_increment;
+    range_min_ = scan.range_min;
+    offset_ = laser_offset;
+    const double d = laser_offset, R = footprint_radius_;
+    for(int i = 0; i < n; i++)
+    {
+      double m = std::max((double) scan.range_min, min_range_);
+      if(R > 0)
+      {
+        double c = cos(scan.angle_min + i * scan.angle_increment);
+        double disc = d * d * c * c - d * d + R * R;
+        if(disc > 0)
+          m = std::max(m, -d * c + sqrt(disc));
+      }
+      min_[i] = m;
+    }
+  }
+
+  ranges_.assign(scan.ranges.begin(), scan.ranges.end());
+  clip((max_range_ > 0) ? std::min((float) max_range_, scan.range_max) : scan.range_max);
+  if(median_window_ > 1)
+    median();
+  if(shadow_angle_ > 0)
+    shadows(scan.angle_increment);
+  return ranges_;
+}
+
+void ScanFilter::clip(float max_range)
+{
+  const int n = ranges_.size();
+  float* r = &ranges_[0];
+  const float* m = &min_[0];
+  // NaN fails both compares
+  for(int i = 0; i < n; i++)
+    r[i] = ((r[i] > m[i]) & (r[i] < max_range)) ? r[i] : 0.0f;
+}
+
+// median by min/max networks, the readings at the ends are kept.
+// Dropped readings stay dropped and are left out of the windows of
+// their neighbours; where that leaves an even number of readings the
+// centre one is taken between the middle two.
+void ScanFilter::median()
+{
+  const int n = ranges_.size();
+  const int h = median_window_ / 2;
+  if(n < median_window_)
+    return;
+  scratch_.assign(ranges_.begin(), ranges_.end());
+  const float* s = &scratch_[0];
+  float* r = &ranges_[0];
+  if(median_window_ == 3)
+  {
+    for(int i = h; i < n - h; i++)
+    {
+      float b = s[i];
+      float a = (s[i - 1] > 0.0f) ? s[i - 1] : b;
+      float c = (s[i + 1] > 0.0f) ? s[i + 1] : b;
+      float m = std::max(std::min(a, b), std::min(std::max(a, b), c));
+      r[i] = (b > 0.0f) ? m : 0.0f;
+    }
+  }
+  else
+  {
+    for(int i = h; i < n - h; i++)
+    {
+      float p0 = s[i - 2], p1 = s[i - 1], p2 = s[i], p3 = s[i + 1], p4 = s[i + 2], c = p2, t;
+      int d = (p0 <= 0.0f) + (p1 <= 0.0f) + (p3 <= 0.0f) + (p4 <= 0.0f);
+      t = std::min(p0, p1); p1 = std::max(p0, p1); p0 = t;
+      t = std::min(p3, p4); p4 = std::max(p3, p4); p3 = t;
+      t = std::min(p2, p4); p4 = std::max(p2, p4); p2 = t;
+      t = std::min(p2, p3); p3 = std::max(p2, p3); p2 = t;
+      t = std::min(p0, p3); p3 = std::max(p0, p3); p0 = t;
+      p2 = std::max(p0, p2);
+      t = std::min(p1, p4); p4 = std::max(p1, p4); p1 = t;
+      t = std::min(p1, p3); p3 = std::max(p1, p3); p1 = t;
+      p2 = std::max(p1, p2);
+      // the d dropped readings sort to the bottom, the rest are p[d..4]
+      float lo = (d < 2) ? p2 : ((d < 4) ? p3 : p4);
+      float hi = (d < 1) ? p2 : ((d < 3) ? p3 : p4);
+      r[i] = (c > 0.0f) ? std::max(lo, std::min(c, hi)) : 0.0f;
+    }
+  }
+}
+
+// the angle between the line joining two points and the beam of the
+// first is atan2(b sin(inc), a - b cos(inc)), a shadow if within
+// shadow_angle of 0 or pi
+void ScanFilter::shadows(float angle_increment)
+{
+  const int n = ranges_.size();
+  if(n < 2)
+    return;
+  const float si = fabs(sin(angle_increment)), ci = cos(angle_increment);
+  const float t = tan(shadow_angle_);
+  scratch_.resize(2 * n);
+  float* r = &ranges_[0];
+  float* far = &scratch_[0];
+  float* drop = &scratch_[n];
+  // far[i]: 1 if of readings i and i+1 the farther is a shadow
+  for(int i = 0; i < n - 1; i++)
+  {
+    float a = r[i], b = r[i + 1];
+    far[i] = ((a > 0.0f) & (b > 0.0f) & (b * si < t * fabsf(a - b * ci))) ? 1.0f : 0.0f;
+  }
+  drop[0] = (far[0] > 0.0f && r[1] < r[0]) ? 1.0f : 0.0f;
+  for(int i = 1; i < n - 1; i++)
+    drop[i] = (((far[i - 1] > 0.0f) & (r[i - 1] < r[i])) | ((far[i] > 0.0f) & (r[i + 1] < r[i]))) ? 1.0f : 0.0f;
+  drop[n - 1] = (far[n - 2] > 0.0f && r[n - 2] < r[n - 1]) ? 1.0f : 0.0f;
+  for(int i = 0; i < n; i++)
+    r[i] = (drop[i] > 0.0f) ? 0.0f : r[i];
+}
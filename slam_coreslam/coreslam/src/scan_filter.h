@@ -0,0 +1,75 @@
+/*
+ * slam_coreslam
+ * Filters applied to laser ranges before they reach CoreSLAM.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_SCAN_FILTER_H
+#define CORESLAM_SCAN_FILTER_H
+
+#include <vector>
+
+#include "ros/ros.h"
+#include "sensor_msgs/LaserScan.h"
+
+/*
+ * A fixed chain, each stage off unless configured, run over one buffer
+ * reused from scan to scan:
+ *
+ *  - clip: readings outside [min_range, max_range], or within
+ *    footprint_radius of the base (the laser being offset along x), or
+ *    not a number, are dropped. The footprint only depends on the beam,
+ *    so it is folded into a per beam minimum range.
+ *  - median: each reading becomes the median of median_window (3 or 5)
+ *    readings around it, which removes the lone spikes of the LDS.
+ *    Readings dropped by clip stay dropped and are left out of the
+ *    windows around them.
+ *  - shadow: of two neighbouring readings whose points lie on a line
+ *    within shadow_angle of the beam, the farther is dropped, as it is
+ *    likely a veiling point between an edge and what is behind it.
+ *
+ * Dropped readings become 0, which CoreSLAM skips. The stages are plain
+ * loops of compares and min/max over floats, which the compiler turns
+ * into SIMD.
+ */
+class ScanFilter
+{
+  public:
+    ScanFilter();
+
+    // Read ~filter/min_range, max_range, footprint_radius (meters),
+    // median_window and shadow_angle (radians)
+    void init(const ros::NodeHandle& nh);
+    void configure(double min_range, double max_range, double footprint_radius,
+                   int median_window, double shadow_angle);
+
+    // True if any stage is on
+    bool enabled() const { return enabled_; }
+
+    // The filtered ranges of scan, laser_offset the x of the laser in
+    // the base frame; scan.ranges itself if no stage is on
+    const std::vector<float>& apply(const sensor_msgs::LaserScan& scan, double laser_offset);
+
+  private:
+    double min_range_;
+    double max_range_;
+    double footprint_radius_;
+    int median_window_;
+    double shadow_angle_;
+    bool enabled_;
+
+    // per beam minimum range, for the scan geometry it was built for
+    std::vector<float> min_;
+    float angle_min_, angle_increment_, range_min_;
+    double offset_;
+
+    std::vector<float> ranges_;
+    std::vector<float> scratch_;
+
+    void clip(float max_range);
+    void median();
+    void shadows(float angle_increment);
+};
+
+#endif
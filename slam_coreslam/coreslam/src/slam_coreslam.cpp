@@ -22,17 +22,16 @@
 #include <iostream>
 #include <time.h>
 #include <math.h>
+#include <algorithm>
 
 #include "ros/ros.h"
 #include "ros/console.h"
 #include "nav_msgs/MapMetaData.h"
 
-// compute linear index for given map coords
-#define MAP_IDX(sx, i, j) ((sx) * (j) + (i))
-
 SlamCoreSlam::SlamCoreSlam():
+  ts_map_(NULL),
   map_to_odom_(tf::Transform(tf::createQuaternionFromRPY( 0, 0, 0 ), tf::Point(0, 0, 0 ))),
-  laser_count_(0), transform_thread_(NULL)
+  laser_count_(0), transform_thread_(NULL), pool_(NULL)
 {
 
   tfB_ = new tf::TransformBroadcaster();
@@ -40,6 +39,7 @@ SlamCoreSlam::SlamCoreSlam():
 
   got_first_scan_ = false;
   got_map_ = false;
+  publishing_ = false;
 
   ros::NodeHandle private_nh_("~");
 
@@ -74,14 +74,140 @@ SlamCoreSlam::SlamCoreSlam():
      delta_ = 0.05;
   ts_map_set_scale(MM_TO_METERS/delta_);
 
+  // Distance to the nearest obstacle, kept up to date around each scan so
+  // the costmap need not transform the whole map for its inflation
+  if(!private_nh_.getParam("publish_distance_map", publish_distance_map_))
+    publish_distance_map_ = false;
+  if(!private_nh_.getParam("max_distance", max_distance_))
+    max_distance_ = 0.5;
+
+  // Match scans against the distance field by Gauss-Newton steps rather
+  // than by CoreSLAM's Monte Carlo search; poor matches (rms error over
+  // matcher_max_error, in meters) are searched again by Monte Carlo
+  std::string matcher;
+  if(!private_nh_.getParam("matcher", matcher))
+    matcher = "monte_carlo";
+  if(matcher != "monte_carlo" && matcher != "distance_field"){
+    ROS_WARN("Unknown matcher %s, using monte_carlo", matcher.c_str());
+    matcher = "monte_carlo";
+  }
+  field_matcher_ = (matcher == "distance_field");
+  if(!private_nh_.getParam("matcher_iterations", matcher_iterations_))
+    matcher_iterations_ = 10;
+  if(!private_nh_.getParam("matcher_max_error", matcher_max_error_))
+    matcher_max_error_ = max_distance_ / 2;
+  use_distance_field_ = publish_distance_map_ || field_matcher_;
+
+  // Clip, median and shadow filters on the ranges, see scan_filter.h,
+  // saving a laser_filters node and its copy of every scan
+  range_filter_.init(ros::NodeHandle("~filter"));
+
+  // Frontiers between free and unknown space for exploration, segments
+  // of fewer than frontier_min_size cells are dropped
+  if(!private_nh_.getParam("publish_frontiers", publish_frontiers_))
+    publish_frontiers_ = false;
+  if(!private_nh_.getParam("frontier_min_size", frontier_min_size_))
+    frontier_min_size_ = 5;
+
+  // Cut the map into submaps linked by a pose graph, closing loops in the
+  // background; CoreSLAM's map becomes a window kept around the robot
+  std::string backend;
+  if(!private_nh_.getParam("backend", backend))
+    backend = "none";
+  if(backend != "none" && backend != "submaps"){
+    ROS_WARN("Unknown backend %s, using none", backend.c_str());
+    backend = "none";
+  }
+  use_submaps_ = (backend == "submaps");
+  double submap_size, submap_distance, loop_search, loop_search_angle, loop_min_score;
+  if(!private_nh_.getParam("submap_size", submap_size))
+    submap_size = 30.0;
+  if(!private_nh_.getParam("submap_distance", submap_distance))
+    submap_distance = 10.0;
+  if(!private_nh_.getParam("recenter_distance", recenter_distance_))
+    recenter_distance_ = 40.0;
+  if(!private_nh_.getParam("loop_search", loop_search))
+    loop_search = 0.5;
+  if(!private_nh_.getParam("loop_search_angle", loop_search_angle))
+    loop_search_angle = 0.17;
+  if(!private_nh_.getParam("loop_min_score", loop_min_score))
+    loop_min_score = 0.5;
+  // Gauss-Seidel sweeps of the pose graph per background pass, passes
+  // repeat until it settles
+  int loop_sweeps;
+  if(!private_nh_.getParam("loop_sweeps", loop_sweeps))
+    loop_sweeps = 1000;
+  // submaps farther than cold_distance (meters) for cold_scans scans are
+  // kept compressed until the robot comes back
+  double cold_distance;
+  int cold_scans;
+  if(!private_nh_.getParam("cold_distance", cold_distance))
+    cold_distance = 20.0;
+  if(!private_nh_.getParam("cold_scans", cold_scans))
+    cold_scans = 300;
+
+  // Keep named maps, one per floor, in ~map_set (a directory) and build
+  // ~map of them, switched with the switch_map service
+  std::string map_set;
+  if(!private_nh_.getParam("map_set", map_set))
+    map_set = "";
+  if(!private_nh_.getParam("map", map_name_))
+    map_name_ = "default";
+  use_map_set_ = false;
+  map_created_ = true;
+  if(!map_set.empty() && map_set_.open(map_set)){
+    ts_map_ = map_set_.map(map_name_, map_created_);
+    use_map_set_ = (ts_map_ != NULL);
+  }
+  if(!use_map_set_)
+    ts_map_ = new ts_map_t;
+
+  // Workers for the map conversion, sized and pinned by ~pool/threads,
+  // ~pool/cpus and ~pool/nice so we can share a board with the vision nodes
+  pool_ = new albany_util::ThreadPool(ros::NodeHandle("~pool"));
+  if(use_submaps_)
+    backend_.init(delta_, submap_size, submap_distance, loop_search, loop_search_angle, loop_min_score,
+                  std::max(1, loop_sweeps), cold_distance, cold_scans, pool_);
+
   sst_ = node_.advertise<nav_msgs::OccupancyGrid>("map", 1, true);
   sstm_ = node_.advertise<nav_msgs::MapMetaData>("map_metadata", 1, true);
+  if(publish_distance_map_)
+    sstd_ = node_.advertise<nav_msgs::OccupancyGrid>("distance_map", 1, true);
+  if(publish_frontiers_)
+    sstf_ = node_.advertise<coreslam::Frontiers>("frontiers", 1, true);
   ss_ = node_.advertiseService("dynamic_map", &SlamCoreSlam::mapCallback, this);
+  if(use_map_set_)
+    switch_ss_ = node_.advertiseService("switch_map", &SlamCoreSlam::switchMapCallback, this);
+  save_ss_ = node_.advertiseService("save_map", &SlamCoreSlam::saveMapCallback, this);
   scan_filter_sub_ = new message_filters::Subscriber<sensor_msgs::LaserScan>(node_, "scan", 5);
   scan_filter_ = new tf::MessageFilter<sensor_msgs::LaserScan>(*scan_filter_sub_, tf_, odom_frame_, 5);
   scan_filter_->registerCallback(boost::bind(&SlamCoreSlam::laserCallback, this, _1));
 
   transform_thread_ = new boost::thread(boost::bind(&SlamCoreSlam::publishLoop, this, transform_publish_period));
+
+  updater_.setHardwareID("none");
+  updater_.add("Allocations", &albany_util::allocDiagnostics);
+  if(use_submaps_)
+    updater_.add("Submaps", this, &SlamCoreSlam::submapDiagnostics);
+  diagnostic_timer_ = node_.createTimer(ros::Duration(1.0), &SlamCoreSlam::diagnosticCallback, this);
+}
+
+void SlamCoreSlam::diagnosticCallback(const ros::TimerEvent& e)
+{
+  updater_.update();
+}
+
+void SlamCoreSlam::submapDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat)
+{
+  stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Submap backend");
+  stat.add("Submaps", backend_.submaps());
+  stat.add("Loop closures", backend_.loopClosures());
+  int resident;
+  size_t resident_bytes, packed_bytes;
+  backend_.memory(resident, resident_bytes, packed_bytes);
+  stat.add("Resident submaps", resident);
+  stat.add("Resident bytes", resident_bytes);
+  stat.add("Compressed bytes", packed_bytes);
 }
 
 void SlamCoreSlam::publishLoop(double transform_publish_period){
@@ -106,6 +232,10 @@ SlamCoreSlam::~SlamCoreSlam()
     delete scan_filter_;
   if (scan_filter_sub_)
     delete scan_filter_sub_;
+  if (pool_)
+    delete pool_;
+  if (!use_map_set_)
+    delete ts_map_;
 }
 
 bool
@@ -166,9 +296,23 @@ SlamCoreSlam::initMapper(const sensor_msgs::LaserScan& scan)
   lparams_.detection_margin = 0;
   lparams_.distance_no_detection = scan.range_max * METERS_TO_MM;
 
-  // new coreslam instance
-  ts_map_init(&ts_map_);
-  ts_state_init(&state_, &ts_map_, &lparams_, &position_, (int)(sigma_xy_*1000), (int)(sigma_theta_*180/M_PI), (int)(hole_width_*1000), 0);
+  // new coreslam instance, on a map of the set as it was left, where
+  // there is something to match against from the first scan
+  if(!use_map_set_)
+    ts_map_init(ts_map_);
+  else if(!map_created_)
+    laser_count_ = std::max(laser_count_, 10);
+  ts_state_init(&state_, ts_map_, &lparams_, &position_, (int)(sigma_xy_*1000), (int)(sigma_theta_*180/M_PI), (int)(hole_width_*1000), 0);
+  if(use_distance_field_)
+    distance_field_.init((int) ceil(max_distance_/delta_));
+  if(publish_frontiers_)
+    frontiers_.init();
+  // no obstacles yet, so all cells are at the maximum distance
+  if(publish_distance_map_)
+    distance_map_.data.assign(TS_MAP_SIZE * TS_MAP_SIZE, 0);
+  // a map of the set may have them all over it
+  if(use_map_set_)
+    startRebuild();
   
   ROS_INFO("Initialized with sigma_xy=%f, sigma_theta=%f, hole_width=%f, delta=%f",sigma_xy_, sigma_theta_, hole_width_, delta_);
   ROS_INFO("Initialization complete");
@@ -178,6 +322,7 @@ SlamCoreSlam::initMapper(const sensor_msgs::LaserScan& scan)
 bool
 SlamCoreSlam::addScan(const sensor_msgs::LaserScan& scan, ts_position_t& odom_pose)
 {
+  ALBANY_TRACE("coreslam/addScan");
   // update odometry
   if(!getOdomPose(odom_pose, scan.header.stamp))
      return false;
@@ -193,38 +338,69 @@ SlamCoreSlam::addScan(const sensor_msgs::LaserScan& scan, ts_position_t& odom_po
   lparams_.angle_min = scan.angle_min * 180/M_PI;
   lparams_.angle_max = scan.angle_max * 180/M_PI;
 
+  // scan_size * span points must fit in a ts_scan_t
+  int max_span = std::max(1, TS_SCAN_SIZE / std::max(1, lparams_.scan_size));
+  if(span_ < 1 || span_ > max_span){
+    int span = std::min(std::max(span_, 1), max_span);
+    ROS_WARN("span %d is out of range for %d readings, using %d", span_, lparams_.scan_size, span);
+    span_ = span;
+  }
+
+  // dropped readings are 0, which both branches skip
+  const std::vector<float>& readings = range_filter_.apply(scan, lparams_.offset);
+
   if(laser_count_ < 10){
     // not much of a map, let's bootstrap for now
     ts_scan_t ranges;
     ranges.nb_points = 0;
-    for(unsigned int i=0; i < scan.ranges.size(); i++)
+    for(unsigned int i=0; i < readings.size(); i++)
     {
       // Must filter out short readings, because the mapper won't
-      if(scan.ranges[i] > scan.range_min && scan.ranges[i] < scan.range_max){
-        ranges.x[ranges.nb_points] = cos(scan.angle_min + i*scan.angle_increment) * (scan.ranges[i]*METERS_TO_MM);
-        ranges.y[ranges.nb_points] = sin(scan.angle_min + i*scan.angle_increment) * (scan.ranges[i]*METERS_TO_MM);
+      if(readings[i] > scan.range_min && readings[i] < scan.range_max){
+        ranges.x[ranges.nb_points] = cos(scan.angle_min + i*scan.angle_increment) * (readings[i]*METERS_TO_MM);
+        ranges.y[ranges.nb_points] = sin(scan.angle_min + i*scan.angle_increment) * (readings[i]*METERS_TO_MM);
         ranges.value[ranges.nb_points] = TS_OBSTACLE;
         ranges.nb_points++;
       }
     }
-    ts_map_update(&ranges, &ts_map_, &state_.position, 50, (int)(hole_width_*1000));  
+    ts_map_update(&ranges, ts_map_, &state_.position, 50, (int)(hole_width_*1000));
+    markScan(ranges, state_.position);
     ROS_DEBUG("Update step, %d, now at (%f, %f, %f)",laser_count_, state_.position.x, state_.position.y, state_.position.theta);
   }else{
     ts_sensor_data_t data;
+    data.timestamp = (unsigned int) (scan.header.stamp.toNSec() / 1000);
     data.position[0] = state_.position;
     if(lparams_.angle_max < lparams_.angle_min){
       // flip readings
-      for(unsigned int i=0; i < scan.ranges.size(); i++)
-        data.d[i] = (int) (scan.ranges[scan.ranges.size()-1-i]*METERS_TO_MM);
+      for(unsigned int i=0; i < readings.size(); i++)
+        data.d[i] = (int) (readings[readings.size()-1-i]*METERS_TO_MM);
     }else{
-      for(unsigned int i=0; i < scan.ranges.size(); i++)
-        data.d[i] = (int) (scan.ranges[i]*METERS_TO_MM);
+      for(unsigned int i=0; i < readings.size(); i++)
+        data.d[i] = (int) (readings[i]*METERS_TO_MM);
     } 
-    ts_iterative_map_building(&data, &state_);  
+    // the map was updated from the final laser pose with state_.scan
+    ts_position_t laser;
+    if(field_matcher_ && !rebuilding_){
+      laser = iterativeMapBuilding(data);
+    }else{
+      ts_iterative_map_building(&data, &state_);
+      laser = state_.position;
+      double thetarad = laser.theta * M_PI / 180;
+      laser.x += state_.laser_params.offset * cos(thetarad);
+      laser.y += state_.laser_params.offset * sin(thetarad);
+    }
+    markScan(state_.scan, laser);
+    if(use_submaps_)
+      backend_.addScan(*ts_map_, state_.position, state_.scan);
     ROS_DEBUG("Iterative step, %d, now at (%f, %f, %f)",laser_count_, state_.position.x, state_.position.y, state_.position.theta);
     ROS_DEBUG("Correction: %f, %f, %f", state_.position.x - prev.x, state_.position.y - prev.y, state_.position.theta - prev.theta);
   }
 
+  if(use_submaps_ && backend_.recenter(*ts_map_, state_.position, recenter_distance_)){
+    ROS_DEBUG("Recentered the map, now at (%f, %f)", state_.position.x, state_.position.y);
+    startRebuild();
+  }
+
   odom_pose = state_.position;
 
   return true;
@@ -233,12 +409,12 @@ SlamCoreSlam::addScan(const sensor_msgs::LaserScan& scan, ts_position_t& odom_po
 void
 SlamCoreSlam::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
 {
+  ALBANY_TRACE("coreslam/laserCallback");
+  ALBANY_ALLOC_SCOPE("laserCallback");
   laser_count_++;
   if ((laser_count_ % throttle_scans_) != 0)
     return;
 
-  static ros::Time last_map_update(0,0);
-
   // We can't initialize CoreSLAM until we've got the first scan
   if(!got_first_scan_)
   {
@@ -251,14 +427,26 @@ SlamCoreSlam::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
   if(addScan(*scan, odom_pose))
   {
     ROS_DEBUG("scan processed");
+    if(finishRebuild() && use_distance_field_)
+      updateDistanceField();
     ROS_DEBUG("odom pose: %.3f %.3f %.3f", odom_pose.x, odom_pose.y, odom_pose.theta);
 
+    // robot in the map frame
+    double map_x = (odom_pose.x-(TS_MAP_SIZE/2)*delta_*METERS_TO_MM)*MM_TO_METERS;
+    double map_y = (odom_pose.y-(TS_MAP_SIZE/2)*delta_*METERS_TO_MM)*MM_TO_METERS;
+    double map_theta = odom_pose.theta*M_PI/180;
+    if(use_submaps_){
+      Pose2D p = backend_.world(odom_pose);
+      map_x = p.x;
+      map_y = p.y;
+      map_theta = p.theta;
+    }
+
     tf::Stamped<tf::Pose> odom_to_map;
     try
     {
-      tf_.transformPose(odom_frame_,tf::Stamped<tf::Pose> (btTransform(tf::createQuaternionFromRPY(0, 0, odom_pose.theta*M_PI/180),
-                                                                    btVector3((odom_pose.x-(TS_MAP_SIZE/2)*delta_*METERS_TO_MM)*MM_TO_METERS, 
-                                                                              (odom_pose.y-(TS_MAP_SIZE/2)*delta_*METERS_TO_MM)*MM_TO_METERS, 0.0)).inverse(),
+      tf_.transformPose(odom_frame_,tf::Stamped<tf::Pose> (btTransform(tf::createQuaternionFromRPY(0, 0, map_theta),
+                                                                    btVector3(map_x, map_y, 0.0)).inverse(),
                                                                     scan->header.stamp, base_frame_),odom_to_map);
     }
     catch(tf::TransformException e){
@@ -267,15 +455,13 @@ SlamCoreSlam::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
     }
 
     // This looks a bit crazy, but localization is currently done *inside* coreslam -- so odom->map never changes. Probably should fix that
-    map_to_odom_mutex_.lock();
-    map_to_odom_ = tf::Transform(tf::Quaternion( odom_to_map.getRotation() ),
-                                 tf::Point(      odom_to_map.getOrigin() ) ).inverse();
-    map_to_odom_mutex_.unlock();
+    map_to_odom_.set(tf::Transform(tf::Quaternion( odom_to_map.getRotation() ),
+                                   tf::Point(      odom_to_map.getOrigin() ) ).inverse());
 
-    if(!got_map_ || (scan->header.stamp - last_map_update) > map_update_interval_)
+    if(!got_map_ || (scan->header.stamp - last_map_update_) > map_update_interval_)
     {
       updateMap();
-      last_map_update = scan->header.stamp;
+      last_map_update_ = scan->header.stamp;
       ROS_DEBUG("Updated the map");
     }
   }
@@ -284,7 +470,9 @@ SlamCoreSlam::laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
 void
 SlamCoreSlam::updateMap()
 {
-  boost::mutex::scoped_lock(map_mutex_);
+  ALBANY_TRACE("coreslam/updateMap");
+  ALBANY_ALLOC_SCOPE("updateMap");
+  boost::mutex::scoped_lock lock(map_mutex_);
 
   if(!got_map_) {
     map_.map.info.resolution = delta_;
@@ -297,7 +485,15 @@ SlamCoreSlam::updateMap()
     map_.map.info.origin.orientation.w = 1.0;
   } 
 
-  if(map_.map.info.width != TS_MAP_SIZE || map_.map.info.height != TS_MAP_SIZE){
+  if(use_submaps_){
+    // grows with the site, so rendered by the backend on the pool, and
+    // published from there
+    if(!publishing_){
+      publishing_ = true;
+      boost::shared_ptr<ts_map_t> live(new ts_map_t(*ts_map_));
+      pool_->post(boost::bind(&SlamCoreSlam::publishSite, this, live), albany_util::ThreadPool::LOW);
+    }
+  }else if(map_.map.info.width != TS_MAP_SIZE || map_.map.info.height != TS_MAP_SIZE){
     map_.map.info.width = TS_MAP_SIZE;
     map_.map.info.height = TS_MAP_SIZE;
     map_.map.info.origin.position.x = -(TS_MAP_SIZE/2)*delta_;
@@ -305,34 +501,350 @@ SlamCoreSlam::updateMap()
     map_.map.data.resize(map_.map.info.width * map_.map.info.height);  
   }
 
-  for(int x=0; x < TS_MAP_SIZE; x++)
-  {
-    for(int y=0; y < TS_MAP_SIZE; y++)
-    {
-      int occ= (int)(ts_map_.map[ y * TS_MAP_SIZE + x]);
-      if(occ == (TS_OBSTACLE+TS_NO_OBSTACLE)/2 )
-        map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = -1;
-      else if(occ < (TS_OBSTACLE+TS_NO_OBSTACLE)/2 )
-        map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = 100;
-      else
-        map_.map.data[MAP_IDX(map_.map.info.width, x, y)] = 0;
-    }
-  }
+  if(!use_submaps_)
+    pool_->parallelFor(0, TS_MAP_SIZE, boost::bind(&SlamCoreSlam::convertMapRows, this, _1, _2));
   got_map_ = true;
 
   //make sure to set the header information on the map
   map_.map.header.stamp = ros::Time::now();
   map_.map.header.frame_id = map_frame_;
 
-  sst_.publish(map_.map);
-  sstm_.publish(map_.map.info);
+  if(!use_submaps_){
+    sst_.publish(map_.map);
+    sstm_.publish(map_.map.info);
+  }
+
+  // the field and the frontiers cover CoreSLAM's map, which the backend moves about
+  Pose2D origin = mapOrigin();
+
+  // until a rebuild is done they are of the old map
+  if(publish_distance_map_ && !rebuilding_){
+    distance_map_.header = map_.map.header;
+    distance_map_.info.map_load_time = map_.map.info.map_load_time;
+    distance_map_.info.resolution = delta_;
+    distance_map_.info.width = TS_MAP_SIZE;
+    distance_map_.info.height = TS_MAP_SIZE;
+    distance_map_.info.origin.position.x = origin.x;
+    distance_map_.info.origin.position.y = origin.y;
+    distance_map_.info.origin.position.z = 0.0;
+    distance_map_.info.origin.orientation = tf::createQuaternionMsgFromYaw(origin.theta);
+    sstd_.publish(distance_map_);
+  }
+
+  if(publish_frontiers_ && !rebuilding_ && frontiers_.update(*ts_map_, frontier_min_size_)){
+    const std::vector<FrontierFinder::Segment>& segments = frontiers_.segments();
+    frontiers_msg_.header = map_.map.header;
+    frontiers_msg_.frontiers.resize(segments.size());
+    for(size_t i = 0; i < segments.size(); i++){
+      const FrontierFinder::Segment& s = segments[i];
+      coreslam::Frontier& f = frontiers_msg_.frontiers[i];
+      origin.transform(s.x * delta_, s.y * delta_, f.centroid.x, f.centroid.y);
+      // corners of the box in the map frame, which the backend may rotate
+      double x[4], y[4];
+      for(int k = 0; k < 4; k++)
+        origin.transform(((k & 1) ? s.x1 : s.x0) * delta_, ((k & 2) ? s.y1 : s.y0) * delta_, x[k], y[k]);
+      f.min.x = *std::min_element(x, x + 4);
+      f.min.y = *std::min_element(y, y + 4);
+      f.max.x = *std::max_element(x, x + 4);
+      f.max.y = *std::max_element(y, y + 4);
+      f.centroid.z = f.min.z = f.max.z = 0.0;
+      f.size = s.size;
+    }
+    sstf_.publish(frontiers_msg_);
+  }
+}
+
+// map frame pose of cell (0,0) of CoreSLAM's map
+Pose2D
+SlamCoreSlam::mapOrigin()
+{
+  if(use_submaps_){
+    ts_position_t corner;
+    corner.x = corner.y = corner.theta = 0;
+    return backend_.world(corner);
+  }
+  return Pose2D(-(TS_MAP_SIZE/2)*delta_, -(TS_MAP_SIZE/2)*delta_, 0);
+}
+
+// render and publish the map of the whole site, on the pool; the grid
+// only lives as long as it takes to send
+void
+SlamCoreSlam::publishSite(boost::shared_ptr<ts_map_t> live)
+{
+  ALBANY_TRACE("coreslam/publishSite");
+  nav_msgs::OccupancyGrid grid;
+  backend_.render(*live, grid);
+  live.reset();
+  grid.header.stamp = ros::Time::now();
+  grid.header.frame_id = map_frame_;
+  sst_.publish(grid);
+  sstm_.publish(grid.info);
+  boost::mutex::scoped_lock lock(map_mutex_);
+  publishing_ = false;
+}
+
+// convert rows [begin, end) of the CoreSLAM map to the occupancy grid
+void
+SlamCoreSlam::convertMapRows(int begin, int end)
+{
+  ALBANY_TRACE("coreslam/convertMapRows");
+  tsMapToOccupancy(*ts_map_, map_.map.data, begin, end);
+}
+
+// recompute the distance field around the cells changed by the last scans
+void
+SlamCoreSlam::updateDistanceField()
+{
+  ALBANY_TRACE("coreslam/updateDistanceField");
+  int x0, y0, x1, y1;
+  if(distance_field_.update(*ts_map_, x0, y0, x1, y1) && publish_distance_map_)
+    distance_field_.toOccupancy(distance_map_.data, x0, x1, y0, y1 + 1);
+}
+
+// mark the cells a map update with scan from position changed, in what
+// is being rebuilt while a rebuild is in flight
+void
+SlamCoreSlam::markScan(const ts_scan_t& scan, const ts_position_t& position)
+{
+  int hole_width = (int)(hole_width_*1000);
+  if(rebuilding_){
+    int x0, y0, x1, y1;
+    scanBounds(scan, position, hole_width, x0, y0, x1, y1);
+    rebuilding_->x0 = std::min(rebuilding_->x0, x0);
+    rebuilding_->y0 = std::min(rebuilding_->y0, y0);
+    rebuilding_->x1 = std::max(rebuilding_->x1, x1);
+    rebuilding_->y1 = std::max(rebuilding_->y1, y1);
+    return;
+  }
+  if(use_distance_field_)
+    distance_field_.markScan(scan, position, hole_width);
+  if(publish_frontiers_)
+    frontiers_.markScan(scan, position, hole_width);
+}
+
+// the field and the frontiers of the whole of job->map, on the pool
+void
+SlamCoreSlam::rebuild(RebuildPtr job, int max_distance, bool field, bool distance_map,
+                      bool frontiers, int frontier_min_size)
+{
+  ALBANY_TRACE("coreslam/rebuild");
+  if(field){
+    job->field.init(max_distance);
+    job->field.markDirty(0, 0, TS_MAP_SIZE-1, TS_MAP_SIZE-1);
+    int x0, y0, x1, y1;
+    if(distance_map){
+      job->distance.assign(TS_MAP_SIZE * TS_MAP_SIZE, 0);
+      if(job->field.update(job->map, x0, y0, x1, y1))
+        job->field.toOccupancy(job->distance, x0, x1, y0, y1 + 1);
+    }else{
+      job->field.update(job->map, x0, y0, x1, y1);
+    }
+  }
+  if(frontiers){
+    job->frontiers.init();
+    job->frontiers.markDirty(0, 0, TS_MAP_SIZE-1, TS_MAP_SIZE-1);
+    job->frontiers.update(job->map, frontier_min_size);
+  }
+  boost::mutex::scoped_lock lock(job->mutex);
+  job->done = true;
+}
+
+// Rebuild the field and the frontiers from a copy of the map, replacing
+// any rebuild still in flight, which is of a map since moved or switched
+void
+SlamCoreSlam::startRebuild()
+{
+  if(!use_distance_field_ && !publish_frontiers_)
+    return;
+  rebuilding_.reset(new Rebuild);
+  rebuilding_->map = *ts_map_;
+  rebuilding_->done = false;
+  rebuilding_->x0 = rebuilding_->y0 = TS_MAP_SIZE;
+  rebuilding_->x1 = rebuilding_->y1 = -1;
+  pool_->post(boost::bind(&SlamCoreSlam::rebuild, rebuilding_, (int) ceil(max_distance_/delta_), use_distance_field_,
+                          publish_distance_map_, publish_frontiers_, frontier_min_size_),
+              albany_util::ThreadPool::LOW);
+}
+
+// Take a finished rebuild, false while one is in flight
+bool
+SlamCoreSlam::finishRebuild()
+{
+  if(!rebuilding_)
+    return true;
+  {
+    boost::mutex::scoped_lock lock(rebuilding_->mutex);
+    if(!rebuilding_->done)
+      return false;
+  }
+  ALBANY_TRACE("coreslam/finishRebuild");
+  Rebuild& done = *rebuilding_;
+  if(use_distance_field_){
+    distance_field_.swap(done.field);
+    if(publish_distance_map_)
+      distance_map_.data.swap(done.distance);
+  }
+  if(publish_frontiers_)
+    frontiers_.swap(done.frontiers);
+  if(done.x0 <= done.x1){
+    if(use_distance_field_)
+      distance_field_.markDirty(done.x0, done.y0, done.x1, done.y1);
+    if(publish_frontiers_)
+      frontiers_.markDirty(done.x0, done.y0, done.x1, done.y1);
+  }
+  rebuilding_.reset();
+  return true;
+}
+
+// ts_iterative_map_building with the distance field matcher, which
+// CoreSLAM doesn't have. As there, scans are matched and drawn from the
+// pose of the laser, and the robot pose is taken back from it. Returns
+// the laser pose.
+ts_position_t
+SlamCoreSlam::iterativeMapBuilding(ts_sensor_data_t& data)
+{
+  ALBANY_TRACE("coreslam/iterativeMapBuilding");
+  scan_builder_.build(data, state_, span_, scan2map_, state_.scan);
+
+  ts_position_t search = state_.position;
+  double thetarad = state_.position.theta * M_PI / 180;
+  search.x += state_.laser_params.offset * cos(thetarad);
+  search.y += state_.laser_params.offset * sin(thetarad);
+
+  double error;
+  ts_position_t position = fieldMatch(distance_field_, state_.scan, search, matcher_iterations_, &error);
+  if(error * delta_ > matcher_max_error_){
+    // out of the capture range of the field, a fast turn or a new area
+    ROS_DEBUG("Field match error %f, searching", error * delta_);
+    int best;
+    position = ts_monte_carlo_search(&state_.randomizer, &state_.scan, ts_map_, &search,
+                                     state_.sigma_xy, state_.sigma_theta, 1000, &best);
+  }
+
+  ts_position_t& robot = data.position[state_.direction];
+  robot = position;
+  thetarad = position.theta * M_PI / 180;
+  robot.x -= state_.laser_params.offset * cos(thetarad);
+  robot.y -= state_.laser_params.offset * sin(thetarad);
+  state_.distance += hypot(robot.x - state_.position.x, robot.y - state_.position.y);
+
+  ts_map_update(&scan2map_, ts_map_, &position, 50, state_.hole_width);
+
+  state_.position = robot;
+  state_.timestamp = data.timestamp;
+  return position;
+}
+
+// write a copy of CoreSLAM's map, on the pool
+static void
+saveTsMap(const std::string& name, boost::shared_ptr<ts_map_t> map, Pose2D origin, double resolution)
+{
+  ALBANY_TRACE("coreslam/saveMap");
+  std::vector<int8_t> data(TS_MAP_SIZE * TS_MAP_SIZE);
+  tsMapToOccupancy(*map, data, 0, TS_MAP_SIZE);
+  if(saveMap(name, data, TS_MAP_SIZE, TS_MAP_SIZE, resolution, origin.x, origin.y, origin.theta))
+    ROS_INFO("Saved map to %s.pgm and %s.yaml", name.c_str(), name.c_str());
+  else
+    ROS_ERROR("Failed to save map to %s", name.c_str());
+}
+
+// render and write the map of the whole site, on the pool
+void
+SlamCoreSlam::saveSite(const std::string& name, boost::shared_ptr<ts_map_t> live)
+{
+  ALBANY_TRACE("coreslam/saveMap");
+  nav_msgs::OccupancyGrid grid;
+  backend_.render(*live, grid);
+  live.reset();
+  if(saveMap(name, grid.data, grid.info.width, grid.info.height, grid.info.resolution,
+             grid.info.origin.position.x, grid.info.origin.position.y, tf::getYaw(grid.info.origin.orientation)))
+    ROS_INFO("Saved map to %s.pgm and %s.yaml", name.c_str(), name.c_str());
+  else
+    ROS_ERROR("Failed to save map to %s", name.c_str());
+}
+
+// Copy the map and leave the conversion and the disk to the pool, so
+// scans don't wait on them and the map never crosses the network
+bool
+SlamCoreSlam::saveMapCallback(coreslam::SaveMap::Request  &req,
+                              coreslam::SaveMap::Response &res)
+{
+  ALBANY_TRACE("coreslam/saveMapCallback");
+  res.success = false;
+  if(!got_first_scan_ || req.name.empty())
+    return true;
+  if(use_submaps_){
+    // the submaps only come together in a rendering of the site
+    boost::shared_ptr<ts_map_t> live(new ts_map_t(*ts_map_));
+    pool_->post(boost::bind(&SlamCoreSlam::saveSite, this, req.name, live), albany_util::ThreadPool::LOW);
+  }else{
+    boost::shared_ptr<ts_map_t> map;
+    {
+      boost::mutex::scoped_lock lock(map_mutex_);
+      map.reset(new ts_map_t(*ts_map_));
+    }
+    pool_->post(boost::bind(&saveTsMap, req.name, map, mapOrigin(), delta_), albany_util::ThreadPool::LOW);
+  }
+  res.success = true;
+  return true;
+}
+
+// Rebind CoreSLAM and everything built on its map to another map of the
+// set. Callbacks are serialized by ros::spin, so no scan is in flight.
+bool
+SlamCoreSlam::switchMapCallback(coreslam::SwitchMap::Request  &req,
+                                coreslam::SwitchMap::Response &res)
+{
+  ALBANY_TRACE("coreslam/switchMapCallback");
+  res.success = false;
+  if(use_submaps_){
+    ROS_ERROR("Cannot switch maps with the submap backend");
+    return true;
+  }
+  bool created;
+  ts_map_t* map = map_set_.map(req.name, created);
+  if(map == NULL)
+    return true;
+
+  {
+    // updateMap() may be converting the old one
+    boost::mutex::scoped_lock lock(map_mutex_);
+    map_set_.flush(ts_map_);
+    ts_map_ = map;
+  }
+  map_name_ = req.name;
+  map_created_ = created;
+  if(got_first_scan_){
+    // the state, pose and random generator carry over
+    state_.map = ts_map_;
+    startRebuild();
+    // nothing to match against on a new floor, so bootstrap it
+    if(created)
+      laser_count_ = 0;
+    // publish it with the next scan
+    last_map_update_ = ros::Time(0, 0);
+  }
+  ROS_INFO("Switched to map %s", map_name_.c_str());
+  res.success = true;
+  return true;
 }
 
 bool
 SlamCoreSlam::mapCallback(nav_msgs::GetMap::Request  &req,
                           nav_msgs::GetMap::Response &res)
 {
-  boost::mutex::scoped_lock(map_mutex_);
+  ALBANY_TRACE("coreslam/mapCallback");
+  if(use_submaps_){
+    // rendered on demand rather than kept; callbacks are serialized by
+    // ros::spin, so the live map is not being written
+    if(!got_first_scan_)
+      return false;
+    backend_.render(*ts_map_, res.map);
+    res.map.header.stamp = ros::Time::now();
+    res.map.header.frame_id = map_frame_;
+    return true;
+  }
+  boost::mutex::scoped_lock lock(map_mutex_);
   if(got_map_ && map_.map.info.width && map_.map.info.height)
   {
     res = map_;
@@ -345,9 +857,8 @@ SlamCoreSlam::mapCallback(nav_msgs::GetMap::Request  &req,
 void 
 SlamCoreSlam::publishTransform()
 {
-  map_to_odom_mutex_.lock();
+  ALBANY_TRACE("coreslam/publishTransform");
   ros::Time tf_expiration = ros::Time::now() + ros::Duration(0.05);
-  tfB_->sendTransform( tf::StampedTransform (map_to_odom_, ros::Time::now(), map_frame_, odom_frame_));
-  map_to_odom_mutex_.unlock();
+  tfB_->sendTransform( tf::StampedTransform (map_to_odom_.get(), ros::Time::now(), map_frame_, odom_frame_));
 }
 
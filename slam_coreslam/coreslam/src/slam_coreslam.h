@@ -29,12 +29,32 @@
 extern "C"{
 #include "CoreSLAM.h"
 }
+#include "map_conversion.h"
+#include "distance_field.h"
+#include "field_matcher.h"
+#include "scan_builder.h"
+#include "map_update.h"
+#include "submaps.h"
+#include "map_set.h"
+#include "frontiers.h"
+#include "scan_filter.h"
+#include "map_export.h"
+#include "coreslam/SwitchMap.h"
+#include "coreslam/SaveMap.h"
+#include "coreslam/Frontiers.h"
 
 #define METERS_TO_MM    1000
 #define MM_TO_METERS    0.001
 
 #include <boost/thread.hpp>
 
+#include "albany_util/latest_value.h"
+#include "albany_util/thread_pool.h"
+#include "albany_util/trace.h"
+#include "albany_util/alloc_profile.h"
+#include "albany_util/alloc_diagnostics.h"
+#include "diagnostic_updater/diagnostic_updater.h"
+
 class SlamCoreSlam
 {
   public:
@@ -46,10 +66,16 @@ class SlamCoreSlam
     void laserCallback(const sensor_msgs::LaserScan::ConstPtr& scan);
     bool mapCallback(nav_msgs::GetMap::Request  &req,
                      nav_msgs::GetMap::Response &res);
+    bool switchMapCallback(coreslam::SwitchMap::Request  &req,
+                           coreslam::SwitchMap::Response &res);
+    bool saveMapCallback(coreslam::SaveMap::Request  &req,
+                         coreslam::SaveMap::Response &res);
     void publishLoop(double transform_publish_period);
+    void diagnosticCallback(const ros::TimerEvent& e);
+    void submapDiagnostics(diagnostic_updater::DiagnosticStatusWrapper& stat);
 
   private:
-    ts_map_t ts_map_;
+    ts_map_t* ts_map_;          // the active map, of the map set or our own
     ts_state_t state_;
     ts_position_t position_;
     ts_position_t prev_odom_;
@@ -58,7 +84,11 @@ class SlamCoreSlam
     ros::NodeHandle node_;
     ros::Publisher sst_;
     ros::Publisher sstm_;
+    ros::Publisher sstd_;
+    ros::Publisher sstf_;
     ros::ServiceServer ss_;
+    ros::ServiceServer switch_ss_;
+    ros::ServiceServer save_ss_;
     tf::TransformListener tf_;
     message_filters::Subscriber<sensor_msgs::LaserScan>* scan_filter_sub_;
     tf::MessageFilter<sensor_msgs::LaserScan>* scan_filter_;
@@ -67,17 +97,51 @@ class SlamCoreSlam
     bool got_first_scan_;
 
     bool got_map_;
-    nav_msgs::GetMap::Response map_;
+    nav_msgs::GetMap::Response map_;    // of the map alone, without submaps
+    bool publishing_;                   // publishSite() in flight
+
+    // distance to the nearest obstacle, updated with each scan
+    DistanceField distance_field_;
+    nav_msgs::OccupancyGrid distance_map_;
+
+    // frontier segments, updated with the map
+    FrontierFinder frontiers_;
+    coreslam::Frontiers frontiers_msg_;
+
+    // The field and the frontiers of a whole map, rebuilt on the pool
+    // when a map of the set is opened or switched to, or when the submap
+    // backend recenters the map. Until it is done the field matcher gives
+    // way to CoreSLAM's, and the cells changed meanwhile are marked dirty
+    // in what it built.
+    struct Rebuild
+    {
+      ts_map_t map;
+      DistanceField field;
+      std::vector<int8_t> distance;
+      FrontierFinder frontiers;
+      boost::mutex mutex;
+      bool done;
+      int x0, y0, x1, y1;       // cells changed since the copy
+    };
+    typedef boost::shared_ptr<Rebuild> RebuildPtr;
+    RebuildPtr rebuilding_;
+    static void rebuild(RebuildPtr job, int max_distance, bool field, bool distance_map,
+                        bool frontiers, int frontier_min_size);
 
     ros::Duration map_update_interval_;
-    tf::Transform map_to_odom_;
-    boost::mutex map_to_odom_mutex_;
+    ros::Time last_map_update_;
+    // written by the laser callback, read by the transform thread
+    albany_util::LatestValue<tf::Transform> map_to_odom_;
     boost::mutex map_mutex_;
 
     int laser_count_;
     int throttle_scans_;
 
     boost::thread* transform_thread_;
+    albany_util::ThreadPool* pool_;
+    albany_util::TraceDumper tracer_;   // ~trace/enabled, ~trace/dump
+    diagnostic_updater::Updater updater_;
+    ros::Timer diagnostic_timer_;
 
     std::string base_frame_;
     std::string laser_frame_;
@@ -85,9 +149,18 @@ class SlamCoreSlam
     std::string odom_frame_;
 
     void updateMap();
+    void convertMapRows(int begin, int end);
+    void publishSite(boost::shared_ptr<ts_map_t> live);
+    void saveSite(const std::string& name, boost::shared_ptr<ts_map_t> live);
+    void updateDistanceField();
+    void markScan(const ts_scan_t& scan, const ts_position_t& position);
+    void startRebuild();
+    bool finishRebuild();
+    Pose2D mapOrigin();
     bool getOdomPose(ts_position_t& ts_pose, const ros::Time &t);
     bool initMapper(const sensor_msgs::LaserScan& scan);
     bool addScan(const sensor_msgs::LaserScan& scan, ts_position_t& pose);
+    ts_position_t iterativeMapBuilding(ts_sensor_data_t& data);
 
     // parameters for coreslam
     double sigma_xy_;
@@ -96,4 +169,37 @@ class SlamCoreSlam
     int span_;
     double delta_;
 
+    // distance field, published on distance_map
+    bool publish_distance_map_;
+    double max_distance_;
+    bool use_distance_field_;
+
+    // frontiers, published on frontiers
+    bool publish_frontiers_;
+    int frontier_min_size_;
+
+    // scan matcher, "monte_carlo" or "distance_field"
+    bool field_matcher_;
+    int matcher_iterations_;
+    double matcher_max_error_;
+
+    // filters run on the ranges of each scan
+    ScanFilter range_filter_;
+
+    // scans for the map update and for matching, built together for the
+    // distance field matcher
+    ScanBuilder scan_builder_;
+    ts_scan_t scan2map_;
+
+    // submap backend, ~backend "submaps", for sites larger than one map
+    bool use_submaps_;
+    double recenter_distance_;
+    SubmapBackend backend_;
+
+    // named maps on disk, ~map_set
+    bool use_map_set_;
+    MapSet map_set_;
+    std::string map_name_;
+    bool map_created_;          // map_name_ was new when opened
+
 };
@@ -0,0 +1,582 @@
+/*
+ * slam_coreslam
+ * Submap and pose graph backend, see submaps.h.
+ */
+
+/* Author: Michael Ferguson */
+
+#include "submaps.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <zlib.h>
+
+#include "ros/ros.h"
+
+#define METERS_TO_MM    1000
+#define MM_TO_METERS    0.001
+
+namespace
+{
+  const ts_map_pixel_t UNKNOWN = (TS_OBSTACLE+TS_NO_OBSTACLE)/2;
+
+  // relative weight of a loop closure against the odometry between submaps
+  const double LOOP_WEIGHT = 1.0;
+
+  // dst[x] = src[x + shift], unknown where that falls off the row
+  void shiftRow(ts_map_pixel_t* dst, const ts_map_pixel_t* src, int shift)
+  {
+    if(shift >= 0)
+    {
+      int n = TS_MAP_SIZE - shift;
+      memmove(dst, src + shift, n * sizeof(ts_map_pixel_t));
+      std::fill(dst + n, dst + TS_MAP_SIZE, UNKNOWN);
+    }
+    else
+    {
+      int n = TS_MAP_SIZE + shift;
+      memmove(dst - shift, src, n * sizeof(ts_map_pixel_t));
+      std::fill(dst, dst - shift, UNKNOWN);
+    }
+  }
+
+  // fastest zlib level, submaps are mostly runs of unknown and free cells,
+  // null if it failed
+  boost::shared_ptr<const std::vector<unsigned char> > pack(const SubmapBackend::Cells& cells)
+  {
+    uLong size = cells.size() * sizeof(ts_map_pixel_t);
+    uLongf length = compressBound(size);
+    std::vector<unsigned char>* packed = new std::vector<unsigned char>(length);
+    int result = compress2(&(*packed)[0], &length, (const Bytef*) &cells[0], size, Z_BEST_SPEED);
+    if(result != Z_OK)
+    {
+      ROS_ERROR("Failed to compress a submap (zlib error %d), keeping it in memory", result);
+      delete packed;
+      return boost::shared_ptr<const std::vector<unsigned char> >();
+    }
+    packed->resize(length);
+    std::vector<unsigned char>(*packed).swap(*packed);
+    return boost::shared_ptr<const std::vector<unsigned char> >(packed);
+  }
+
+  // all unknown if the data is damaged
+  SubmapBackend::CellsPtr unpack(const std::vector<unsigned char>& packed, int count)
+  {
+    SubmapBackend::Cells* cells = new SubmapBackend::Cells(count);
+    uLongf length = count * sizeof(ts_map_pixel_t);
+    int result = uncompress((Bytef*) &(*cells)[0], &length, &packed[0], packed.size());
+    if(result != Z_OK || length != count * sizeof(ts_map_pixel_t))
+    {
+      ROS_ERROR("Failed to decompress a submap (zlib error %d), treating it as unknown", result);
+      cells->assign(count, UNKNOWN);
+    }
+    return SubmapBackend::CellsPtr(cells);
+  }
+}
+
+SubmapBackend::SubmapBackend():
+  resolution_(0.05), cell_mm_(50), size_(0), submap_distance_(0),
+  loop_search_(0), loop_search_angle_(0), loop_min_score_(0), loop_sweeps_(0), cold_distance_(0), cold_scans_(0),
+  pool_(NULL), shift_x_(0), shift_y_(0), started_(false), closures_(0), settled_(true), running_(false),
+  scans_(0), tiering_(false)
+{
+}
+
+SubmapBackend::~SubmapBackend()
+{
+}
+
+void SubmapBackend::init(double resolution, double submap_size, double submap_distance,
+                         double loop_search, double loop_search_angle, double loop_min_score,
+                         int loop_sweeps, double cold_distance, int cold_scans,
+                         albany_util::ThreadPool* pool)
+{
+  resolution_ = resolution;
+  cell_mm_ = resolution * METERS_TO_MM;
+  size_ = (int) ceil(submap_size / resolution);
+  submap_distance_ = submap_distance;
+  loop_search_ = loop_search;
+  loop_search_angle_ = loop_search_angle;
+  loop_min_score_ = loop_min_score;
+  loop_sweeps_ = loop_sweeps;
+  cold_distance_ = cold_distance;
+  cold_scans_ = cold_scans;
+  pool_ = pool;
+}
+
+Pose2D SubmapBackend::raw(const ts_position_t& position) const
+{
+  const double center = (TS_MAP_SIZE/2) * cell_mm_;
+  return Pose2D((position.x - center + shift_x_) * MM_TO_METERS,
+                (position.y - center + shift_y_) * MM_TO_METERS,
+                normalizeAngle(position.theta * M_PI / 180));
+}
+
+Pose2D SubmapBackend::world(const ts_position_t& position) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return correction_ * raw(position);
+}
+
+void SubmapBackend::addScan(const ts_map_t& map, const ts_position_t& position, const ts_scan_t& scan)
+{
+  Pose2D r = raw(position);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    scans_++;
+    robot_ = correction_ * r;
+    // check which submaps to compress or bring back every few scans
+    if(pool_ && !tiering_ && scans_ % 10 == 0)
+    {
+      tiering_ = true;
+      pool_->post(boost::bind(&SubmapBackend::tier, this), albany_util::ThreadPool::LOW);
+    }
+  }
+  if(!started_)
+  {
+    started_ = true;
+    segment_start_ = r;
+    return;
+  }
+  if(hypot(r.x - segment_start_.x, r.y - segment_start_.y) < submap_distance_)
+    return;
+
+  // the window around the path driven since the last cut
+  Pose2D center((r.x + segment_start_.x) / 2, (r.y + segment_start_.y) / 2, 0);
+  cut(map, center, scan, r);
+  segment_start_ = r;
+}
+
+void SubmapBackend::cut(const ts_map_t& map, const Pose2D& center, const ts_scan_t& scan, const Pose2D& scan_pose)
+{
+  const double ts_center = (TS_MAP_SIZE/2) * cell_mm_;
+  SubmapPtr s(new Submap);
+  s->size = size_;
+
+  // align the submap with the cells of the live map, so they copy across
+  int cx0 = (int) floor((center.x * METERS_TO_MM - shift_x_ + ts_center) / cell_mm_ + 0.5) - size_ / 2;
+  int cy0 = (int) floor((center.y * METERS_TO_MM - shift_y_ + ts_center) / cell_mm_ + 0.5) - size_ / 2;
+  s->origin = Pose2D((cx0 * cell_mm_ - ts_center + shift_x_) * MM_TO_METERS,
+                     (cy0 * cell_mm_ - ts_center + shift_y_) * MM_TO_METERS, 0);
+  Cells* cells = new Cells(size_ * size_, UNKNOWN);
+  s->cells.reset(cells);
+  s->last_near = scans_;
+  int x0 = std::max(0, cx0), x1 = std::min(TS_MAP_SIZE, cx0 + size_);
+  for(int y = 0; y < size_ && x0 < x1; y++)
+  {
+    int ty = cy0 + y;
+    if(ty < 0 || ty >= TS_MAP_SIZE)
+      continue;
+    memcpy(&(*cells)[y * size_ + (x0 - cx0)], &map.map[ty * TS_MAP_SIZE + x0], (x1 - x0) * sizeof(ts_map_pixel_t));
+  }
+
+  // the last scan, to close loops with
+  s->scan_pose = scan_pose;
+  for(int i = 0; i < scan.nb_points; i++)
+  {
+    if(scan.value[i] != TS_OBSTACLE)
+      continue;
+    s->scan_x.push_back(scan.x[i] * MM_TO_METERS);
+    s->scan_y.push_back(scan.y[i] * MM_TO_METERS);
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  int id = graph_.addNode(correction_ * s->origin);
+  if(id > 0)
+    graph_.addEdge(id - 1, id, between(submaps_[id - 1]->origin, s->origin), 1.0);
+  submaps_.push_back(s);
+  pending_.push_back(id);
+  if(!running_ && pool_)
+  {
+    running_ = true;
+    pool_->post(boost::bind(&SubmapBackend::background, this), albany_util::ThreadPool::LOW);
+  }
+}
+
+// loop closure and relaxation, on the pool
+void SubmapBackend::background()
+{
+  while(true)
+  {
+    SubmapPtr submap;
+    int id = -1;
+    std::vector<int> candidates;
+    std::vector<Pose2D> predictions;
+    std::vector<SubmapPtr> others;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if(pending_.empty() && settled_)
+      {
+        running_ = false;
+        return;
+      }
+      if(!pending_.empty())
+      {
+        id = pending_.front();
+        pending_.erase(pending_.begin());
+        submap = submaps_[id];
+
+        // older submaps the scan falls in, bar the previous which is linked already
+        Pose2D scan_world = graph_.node(id) * between(submap->origin, submap->scan_pose);
+        double extent = size_ * resolution_;
+        for(int i = 0; i + 1 < id; i++)
+        {
+          Pose2D p = between(graph_.node(i), scan_world);
+          if(p.x >= 0 && p.y >= 0 && p.x < extent && p.y < extent)
+          {
+            candidates.push_back(i);
+            predictions.push_back(p);
+            others.push_back(submaps_[i]);
+          }
+        }
+      }
+    }
+
+    std::vector<PoseGraph::Edge> closures;
+    if(submap)
+    {
+      Pose2D scan_in_submap = between(submap->origin, submap->scan_pose);
+      for(size_t k = 0; k < candidates.size(); k++)
+      {
+        Pose2D p = predictions[k];
+        double score;
+        CellsPtr cells = load(others[k]);
+        if(!match(*cells, others[k]->size, submap->scan_x, submap->scan_y, p, score))
+          continue;
+        PoseGraph::Edge e;
+        e.from = candidates[k];
+        e.to = id;
+        e.measurement = p * scan_in_submap.inverse();
+        e.weight = LOOP_WEIGHT;
+        closures.push_back(e);
+      }
+    }
+
+    // relax a copy, the laser thread keeps adding submaps meanwhile
+    PoseGraph graph;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if(closures.empty() && settled_)
+        continue;
+      for(size_t k = 0; k < closures.size(); k++)
+        graph_.addEdge(closures[k].from, closures[k].to, closures[k].measurement, closures[k].weight);
+      closures_ += closures.size();
+      graph = graph_;
+    }
+    bool settled = graph.optimize(loop_sweeps_, 1e-4);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      int n = graph.size();
+      // submaps cut since the copy move with the newest one relaxed
+      Pose2D delta = graph.node(n - 1) * graph_.node(n - 1).inverse();
+      for(int i = 0; i < n; i++)
+        graph_.setNode(i, graph.node(i));
+      for(int i = n; i < graph_.size(); i++)
+        graph_.setNode(i, delta * graph_.node(i));
+      correction_ = graph_.node(graph_.size() - 1) * submaps_.back()->origin.inverse();
+      settled_ = settled;
+      // carry on in a later pass, leaving the workers to other tasks
+      if(!settled_ && pending_.empty())
+      {
+        pool_->post(boost::bind(&SubmapBackend::background, this), albany_util::ThreadPool::LOW);
+        return;
+      }
+    }
+  }
+}
+
+// compress submaps the robot left a while ago, bring back those it nears
+void SubmapBackend::tier()
+{
+  std::vector<SubmapPtr> freeze, thaw;
+  std::vector<CellsPtr> freeze_cells;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    double half = size_ * resolution_ / 2;
+    for(int i = 0; i < (int) submaps_.size(); i++)
+    {
+      Submap& s = *submaps_[i];
+      double x, y;
+      graph_.node(i).transform(half, half, x, y);
+      if(hypot(x - robot_.x, y - robot_.y) < cold_distance_ + half)
+      {
+        s.last_near = scans_;
+        if(!s.cells)
+          thaw.push_back(submaps_[i]);
+      }
+      else if(s.cells && scans_ - s.last_near > cold_scans_)
+      {
+        freeze.push_back(submaps_[i]);
+        freeze_cells.push_back(s.cells);
+      }
+    }
+  }
+
+  // cells never change after the cut, so each submap is packed only once
+  for(size_t k = 0; k < freeze.size(); k++)
+  {
+    boost::shared_ptr<const std::vector<unsigned char> > packed = freeze[k]->packed;
+    if(!packed)
+      packed = pack(*freeze_cells[k]);
+    if(!packed)
+      continue;
+    boost::mutex::scoped_lock lock(mutex_);
+    freeze[k]->packed = packed;
+    freeze[k]->cells.reset();
+  }
+  for(size_t k = 0; k < thaw.size(); k++)
+  {
+    CellsPtr cells = load(thaw[k]);
+    boost::mutex::scoped_lock lock(mutex_);
+    if(!thaw[k]->cells)
+      thaw[k]->cells = cells;
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  tiering_ = false;
+}
+
+SubmapBackend::CellsPtr SubmapBackend::load(const SubmapPtr& submap) const
+{
+  CellsPtr cells;
+  boost::shared_ptr<const std::vector<unsigned char> > packed;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    cells = submap->cells;
+    packed = submap->packed;
+  }
+  if(cells)
+    return cells;
+  return unpack(*packed, submap->size * submap->size);
+}
+
+// Exhaustive search of the scan around pose, in the frame of the submap.
+// Scores are the mean obstacle value under the points, unknown cells
+// counting as free but at least half the points must be on known cells.
+bool SubmapBackend::match(const Cells& cells, int size, const std::vector<float>& xs, const std::vector<float>& ys,
+                          Pose2D& pose, double& score) const
+{
+  const int n = xs.size();
+  if(n < 10)
+    return false;
+  const int steps = (int) ceil(loop_search_ / resolution_);
+  // a step moves the farthest point by about a cell
+  double range = 0;
+  for(int k = 0; k < n; k++)
+    range = std::max(range, (double) hypot(xs[k], ys[k]));
+  const double angle_step = std::min(M_PI / 180, resolution_ / std::max(range, resolution_));
+  const int angle_steps = (int) ceil(loop_search_angle_ / angle_step);
+
+  std::vector<int> px(n), py(n);
+  double best = -1;
+  Pose2D best_pose = pose;
+  for(int a = -angle_steps; a <= angle_steps; a++)
+  {
+    double theta = pose.theta + a * angle_step;
+    double c = cos(theta), s = sin(theta);
+    for(int k = 0; k < n; k++)
+    {
+      px[k] = (int) floor((pose.x + c * xs[k] - s * ys[k]) / resolution_ + 0.5);
+      py[k] = (int) floor((pose.y + s * xs[k] + c * ys[k]) / resolution_ + 0.5);
+    }
+    for(int dy = -steps; dy <= steps; dy++)
+    {
+      for(int dx = -steps; dx <= steps; dx++)
+      {
+        double sum = 0;
+        int known = 0;
+        for(int k = 0; k < n; k++)
+        {
+          int x = px[k] + dx, y = py[k] + dy;
+          if(x < 0 || y < 0 || x >= size || y >= size)
+            continue;
+          int v = cells[y * size + x];
+          if(v == UNKNOWN)
+            continue;
+          known++;
+          if(v < UNKNOWN)
+            sum += (double) (UNKNOWN - v) / UNKNOWN;
+        }
+        if(2 * known < n || sum / n <= best)
+          continue;
+        best = sum / n;
+        best_pose = Pose2D(pose.x + dx * resolution_, pose.y + dy * resolution_, normalizeAngle(theta));
+      }
+    }
+  }
+  score = best;
+  if(best < loop_min_score_)
+    return false;
+  pose = best_pose;
+  return true;
+}
+
+bool SubmapBackend::recenter(ts_map_t& map, ts_position_t& position, double distance)
+{
+  const double center = (TS_MAP_SIZE/2) * cell_mm_;
+  double dx = position.x - center, dy = position.y - center;
+  if(hypot(dx, dy) < distance * METERS_TO_MM)
+    return false;
+
+  // move the map by whole cells: new (x,y) is old (x+sx,y+sy)
+  int sx = (int) floor(dx / cell_mm_ + 0.5);
+  int sy = (int) floor(dy / cell_mm_ + 0.5);
+  if(abs(sx) >= TS_MAP_SIZE || abs(sy) >= TS_MAP_SIZE)
+  {
+    std::fill(map.map, map.map + TS_MAP_SIZE * TS_MAP_SIZE, UNKNOWN);
+  }
+  else if(sy >= 0)
+  {
+    for(int y = 0; y < TS_MAP_SIZE; y++)
+    {
+      if(y + sy < TS_MAP_SIZE)
+        shiftRow(&map.map[y * TS_MAP_SIZE], &map.map[(y + sy) * TS_MAP_SIZE], sx);
+      else
+        std::fill(&map.map[y * TS_MAP_SIZE], &map.map[(y + 1) * TS_MAP_SIZE], UNKNOWN);
+    }
+  }
+  else
+  {
+    for(int y = TS_MAP_SIZE - 1; y >= 0; y--)
+    {
+      if(y + sy >= 0)
+        shiftRow(&map.map[y * TS_MAP_SIZE], &map.map[(y + sy) * TS_MAP_SIZE], sx);
+      else
+        std::fill(&map.map[y * TS_MAP_SIZE], &map.map[(y + 1) * TS_MAP_SIZE], UNKNOWN);
+    }
+  }
+
+  position.x -= sx * cell_mm_;
+  position.y -= sy * cell_mm_;
+  shift_x_ += sx * cell_mm_;
+  shift_y_ += sy * cell_mm_;
+  return true;
+}
+
+// paint the known cells of a grid whose cell (0,0) is at frame
+void SubmapBackend::paint(const ts_map_pixel_t* cells, int stride, int width, int height, const Pose2D& frame,
+                          nav_msgs::OccupancyGrid& grid) const
+{
+  // bounds of the grid in the output
+  double min_x = 1e30, min_y = 1e30, max_x = -1e30, max_y = -1e30;
+  for(int k = 0; k < 4; k++)
+  {
+    double x, y;
+    frame.transform((k & 1) ? (width - 1) * resolution_ : 0, (k & 2) ? (height - 1) * resolution_ : 0, x, y);
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+  }
+  const double ox = grid.info.origin.position.x, oy = grid.info.origin.position.y;
+  const int gw = grid.info.width, gh = grid.info.height;
+  int i0 = std::max(0, (int) floor((min_x - ox) / resolution_) - 1);
+  int i1 = std::min(gw - 1, (int) ceil((max_x - ox) / resolution_) + 1);
+  int j0 = std::max(0, (int) floor((min_y - oy) / resolution_) - 1);
+  int j1 = std::min(gh - 1, (int) ceil((max_y - oy) / resolution_) + 1);
+
+  // step through the grid's cells in the frame of the painted one
+  Pose2D inv = frame.inverse();
+  double c = cos(inv.theta), s = sin(inv.theta);
+  for(int j = j0; j <= j1; j++)
+  {
+    double wy = oy + j * resolution_;
+    for(int i = i0; i <= i1; i++)
+    {
+      double wx = ox + i * resolution_;
+      int u = (int) floor((inv.x + c * wx - s * wy) / resolution_ + 0.5);
+      int v = (int) floor((inv.y + s * wx + c * wy) / resolution_ + 0.5);
+      if(u < 0 || v < 0 || u >= width || v >= height)
+        continue;
+      int occ = cells[v * stride + u];
+      if(occ == UNKNOWN)
+        continue;
+      grid.data[j * gw + i] = (occ < UNKNOWN) ? 100 : 0;
+    }
+  }
+}
+
+void SubmapBackend::render(const ts_map_t& map, nav_msgs::OccupancyGrid& grid) const
+{
+  const double ts_center = (TS_MAP_SIZE/2) * cell_mm_;
+  Pose2D live;
+  std::vector<SubmapPtr> submaps;
+  std::vector<Pose2D> frames;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    // world frame of the live map's cell (0,0)
+    live = correction_ * Pose2D((shift_x_ - ts_center) * MM_TO_METERS, (shift_y_ - ts_center) * MM_TO_METERS, 0);
+    submaps = submaps_;
+    for(int i = 0; i < (int) submaps_.size(); i++)
+      frames.push_back(graph_.node(i));
+  }
+
+  // bounds of everything to paint
+  double min_x = 1e30, min_y = 1e30, max_x = -1e30, max_y = -1e30;
+  for(int i = -1; i < (int) submaps.size(); i++)
+  {
+    const Pose2D& frame = (i < 0) ? live : frames[i];
+    double extent = ((i < 0) ? TS_MAP_SIZE : size_) * resolution_;
+    for(int k = 0; k < 4; k++)
+    {
+      double x, y;
+      frame.transform((k & 1) ? extent : 0, (k & 2) ? extent : 0, x, y);
+      min_x = std::min(min_x, x);
+      max_x = std::max(max_x, x);
+      min_y = std::min(min_y, y);
+      max_y = std::max(max_y, y);
+    }
+  }
+  grid.info.resolution = resolution_;
+  grid.info.origin.position.x = floor(min_x / resolution_) * resolution_;
+  grid.info.origin.position.y = floor(min_y / resolution_) * resolution_;
+  grid.info.origin.position.z = 0.0;
+  grid.info.origin.orientation.x = 0.0;
+  grid.info.origin.orientation.y = 0.0;
+  grid.info.origin.orientation.z = 0.0;
+  grid.info.origin.orientation.w = 1.0;
+  grid.info.width = (int) ceil((max_x - grid.info.origin.position.x) / resolution_) + 1;
+  grid.info.height = (int) ceil((max_y - grid.info.origin.position.y) / resolution_) + 1;
+  grid.data.assign(grid.info.width * grid.info.height, -1);
+
+  // oldest first, the live map last, newer data wins
+  for(size_t i = 0; i < submaps.size(); i++)
+  {
+    int size = submaps[i]->size;
+    CellsPtr cells = load(submaps[i]);
+    paint(&(*cells)[0], size, size, size, frames[i], grid);
+  }
+  paint(map.map, TS_MAP_SIZE, TS_MAP_SIZE, TS_MAP_SIZE, live, grid);
+}
+
+int SubmapBackend::submaps() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return submaps_.size();
+}
+
+int SubmapBackend::loopClosures() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return closures_;
+}
+
+void SubmapBackend::memory(int& resident, size_t& resident_bytes, size_t& packed_bytes) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  resident = 0;
+  resident_bytes = packed_bytes = 0;
+  for(size_t i = 0; i < submaps_.size(); i++)
+  {
+    const Submap& s = *submaps_[i];
+    if(s.cells)
+    {
+      resident++;
+      resident_bytes += s.cells->size() * sizeof(ts_map_pixel_t);
+    }
+    if(s.packed)
+      packed_bytes += s.packed->size();
+  }
+}
@@ -0,0 +1,144 @@
+/*
+ * slam_coreslam
+ * Submap and pose graph backend, for sites larger than one CoreSLAM map.
+ */
+
+/* Author: Michael Ferguson */
+
+#ifndef CORESLAM_SUBMAPS_H
+#define CORESLAM_SUBMAPS_H
+
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "nav_msgs/OccupancyGrid.h"
+#include "albany_util/thread_pool.h"
+
+extern "C"{
+#include "CoreSLAM.h"
+}
+#include "pose_graph.h"
+
+/*
+ * CoreSLAM keeps mapping into its one 2048x2048 map, which becomes the
+ * live window around the robot: when the robot nears its edge the map is
+ * shifted back under it, so the cost of a scan doesn't depend on the size
+ * of the site.
+ *
+ * Every submap_distance of travel the part of the live map around the
+ * path just driven is copied out as a submap and becomes a node of a pose
+ * graph, linked to the previous submap by the relative pose CoreSLAM
+ * tracked between them. A background task on the pool matches the last
+ * scan of each new submap against the older submaps it falls in, adding
+ * a loop closure edge for each good match, and relaxes the graph, up to
+ * loop_sweeps sweeps a pass and as many passes as it takes to settle. The
+ * correction of the newest submap then carries the live map and the
+ * robot into the optimized world frame.
+ *
+ * Submaps the robot hasn't come near for cold_scans scans are compressed
+ * on the pool, once, as they never change after the cut, and their cells
+ * dropped; when the robot comes back within cold_distance they are
+ * decompressed again ahead of it. Anything else needing the cells of a
+ * cold submap decompresses a transient copy. The map of the whole site
+ * is only rendered when it is published or asked for, and not kept, so
+ * memory follows the area around the robot rather than the whole site.
+ *
+ * Three frames are involved: CoreSLAM's (mm and degrees, moved by each
+ * shift), the raw frame (meters and radians, CoreSLAM's with the shifts
+ * undone) and the world, or map, frame of the optimized graph.
+ */
+class SubmapBackend
+{
+  public:
+    typedef std::vector<ts_map_pixel_t> Cells;
+    typedef boost::shared_ptr<const Cells> CellsPtr;
+
+    struct Submap
+    {
+      Pose2D origin;                      // raw pose of cell (0,0)
+      int size;                           // cells per side
+      CellsPtr cells;                     // null while cold
+      boost::shared_ptr<const std::vector<unsigned char> > packed;  // zlib
+      int last_near;                      // scan the robot was last near
+      Pose2D scan_pose;                   // raw pose of the closing scan
+      std::vector<float> scan_x, scan_y;  // its obstacle points, meters
+    };
+    typedef boost::shared_ptr<Submap> SubmapPtr;
+
+    SubmapBackend();
+    ~SubmapBackend();
+
+    // resolution in meters per cell, sizes and distances in meters,
+    // angles in radians, pool runs closures, the optimization and the
+    // compression
+    void init(double resolution, double submap_size, double submap_distance,
+              double loop_search, double loop_search_angle, double loop_min_score,
+              int loop_sweeps, double cold_distance, int cold_scans,
+              albany_util::ThreadPool* pool);
+
+    // Raw pose of a CoreSLAM position
+    Pose2D raw(const ts_position_t& position) const;
+    // World pose of a CoreSLAM position
+    Pose2D world(const ts_position_t& position) const;
+
+    // After scan updated map from position, cuts a submap when due
+    void addScan(const ts_map_t& map, const ts_position_t& position, const ts_scan_t& scan);
+
+    // Shift map to bring position back within distance (meters) of its
+    // middle, returns false if it already was
+    bool recenter(ts_map_t& map, ts_position_t& position, double distance);
+
+    // Paint the submaps at their optimized poses, then the live map, into
+    // grid, sized to the site. The grid is built on demand and not kept:
+    // cold submaps are decompressed one at a time while they are painted.
+    void render(const ts_map_t& map, nav_msgs::OccupancyGrid& grid) const;
+
+    int submaps() const;
+    int loopClosures() const;
+    // submaps with their cells in memory, and the bytes of cells and of
+    // compressed submaps
+    void memory(int& resident, size_t& resident_bytes, size_t& packed_bytes) const;
+
+  private:
+    double resolution_;
+    double cell_mm_;
+    int size_;                  // submap size in cells
+    double submap_distance_;
+    double loop_search_;
+    double loop_search_angle_;
+    double loop_min_score_;
+    int loop_sweeps_;
+    double cold_distance_;
+    int cold_scans_;
+    albany_util::ThreadPool* pool_;
+
+    // offset of CoreSLAM's frame in the raw frame, mm, from the shifts
+    double shift_x_, shift_y_;
+    bool started_;
+    Pose2D segment_start_;
+
+    mutable boost::mutex mutex_;
+    std::vector<SubmapPtr> submaps_;
+    PoseGraph graph_;
+    Pose2D correction_;         // raw to world
+    int closures_;
+    std::vector<int> pending_;  // submaps waiting for loop closure
+    bool settled_;              // the last relaxation converged
+    bool running_;
+    int scans_;                 // addScan() calls, the clock for cold submaps
+    Pose2D robot_;              // world pose at the last addScan()
+    bool tiering_;
+
+    void cut(const ts_map_t& map, const Pose2D& center, const ts_scan_t& scan, const Pose2D& scan_pose);
+    void background();
+    void tier();
+    // cells of a submap, decompressed if cold
+    CellsPtr load(const SubmapPtr& submap) const;
+    bool match(const Cells& cells, int size, const std::vector<float>& xs, const std::vector<float>& ys,
+               Pose2D& pose, double& score) const;
+    void paint(const ts_map_pixel_t* cells, int stride, int width, int height, const Pose2D& frame,
+               nav_msgs::OccupancyGrid& grid) const;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * slam_coreslam
+ * Checks of the laser range filters against plain implementations.
+ */
+
+/* Author: Michael Ferguson */
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "../src/scan_filter.h"
+
+namespace
+{
+  sensor_msgs::LaserScan makeScan (int n)
+  {
+    sensor_msgs::LaserScan scan;
+    scan.angle_min = -M_PI;
+    scan.angle_increment = M_PI / 180;
+    scan.range_min = 0.06;
+    scan.range_max = 5.0;
+    scan.ranges.resize(n);
+    return scan;
+  }
+
+  // median of the readings of the window which were not dropped, with
+  // the reading itself added to an even number of them
+  float bruteMedian (const std::vector<float>& r, int i, int window)
+  {
+    if(r[i] <= 0.0f)
+      return 0.0f;
+    std::vector<float> v;
+    for(int k = i - window / 2; k <= i + window / 2; k++)
+      if(r[k] > 0.0f)
+        v.push_back(r[k]);
+    if(v.size() % 2 == 0)
+      v.push_back(r[i]);
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+  }
+}
+
+TEST(ScanFilter, MedianMatchesBruteForce)
+{
+  const int n = 360;
+  sensor_msgs::LaserScan scan = makeScan(n);
+  srand(1);
+  for(int it = 0; it < 200; it++)
+  {
+    // one in four readings dropped by the clip stage, some in runs
+    for(int i = 0; i < n; i++)
+    {
+      int k = rand() % 8;
+      scan.ranges[i] = (k == 0) ? 0.0f : (k == 1) ? 9.0f : (k == 2) ? NAN : 0.1f + (rand() % 4000) / 1000.0f;
+    }
+    std::vector<float> clipped(n);
+    for(int i = 0; i < n; i++)
+      clipped[i] = (scan.ranges[i] > scan.range_min && scan.ranges[i] < scan.range_max) ? scan.ranges[i] : 0.0f;
+
+    for(int window = 3; window <= 5; window += 2)
+    {
+      ScanFilter filter;
+      filter.configure(0, 0, 0, window, 0);
+      const std::vector<float>& out = filter.apply(scan, 0);
+      ASSERT_EQ(n, (int) out.size());
+      for(int i = window / 2; i < n - window / 2; i++)
+        ASSERT_EQ(bruteMedian(clipped, i, window), out[i]) << "window " << window << " reading " << i;
+    }
+  }
+}
+
+TEST(ScanFilter, MedianKeepsDroppedReadingsDropped)
+{
+  sensor_msgs::LaserScan scan = makeScan(9);
+  for(int window = 3; window <= 5; window += 2)
+  {
+    ScanFilter filter;
+    filter.configure(0, 0, 0, window, 0);
+
+    // a reading dropped between two valid ones, out of range or not a number
+    const float dropped[3] = { 0.0f, 9.0f, NAN };
+    for(int k = 0; k < 3; k++)
+    {
+      scan.ranges.assign(9, 1.0f);
+      scan.ranges[4] = dropped[k];
+      EXPECT_EQ(0.0f, filter.apply(scan, 0)[4]);
+    }
+
+    // a valid reading between two dropped ones
+    scan.ranges.assign(9, 1.0f);
+    scan.ranges[3] = 0.0f;
+    scan.ranges[4] = 2.0f;
+    scan.ranges[5] = 0.0f;
+    const std::vector<float>& out = filter.apply(scan, 0);
+    EXPECT_EQ(0.0f, out[3]);
+    EXPECT_EQ(0.0f, out[5]);
+    EXPECT_LT(0.0f, out[4]);
+  }
+}
+
+int main (int argc, char ** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}